@@ -0,0 +1,228 @@
+//
+// Anti-aliasing benchmark: the MSAA sample counts against the SSAA path they replaced.
+// Run: ./RasterizerBench
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+#include <eigen3/Eigen/Eigen>
+
+#include "rasterizer.hpp"
+#include "triangle_setup.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int width = 700, height = 700;
+
+static double elapsed_ms(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Triangles in normalized device coordinates, drawn with identity matrices.
+struct scene
+{
+    std::vector<Eigen::Vector3f> positions;
+    std::vector<Eigen::Vector3i> indices;
+    std::vector<Eigen::Vector3f> colors;
+};
+
+static scene random_scene(int count, float size, int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> pos(-1 + size, 1 - size);
+    std::uniform_real_distribution<float> offset(-size, size);
+    std::uniform_real_distribution<float> depth(-1, 1);
+    std::uniform_real_distribution<float> channel(0, 255);
+    scene s;
+    for (int i = 0; i < count; ++i)
+    {
+        float cx = pos(rng), cy = pos(rng), z = depth(rng);
+        Eigen::Vector3f color(channel(rng), channel(rng), channel(rng));
+        for (int j = 0; j < 3; ++j)
+        {
+            s.positions.emplace_back(cx + offset(rng), cy + offset(rng), z);
+            s.colors.push_back(color);
+        }
+        s.indices.emplace_back(3 * i, 3 * i + 1, 3 * i + 2);
+    }
+    return s;
+}
+
+// The SSAA path MSAA replaced, kept as the baseline: four fixed samples in a heap vector per pixel,
+// reset by assigning a fresh vector each frame, one color per pixel (the last triangle to win any
+// sample) and the covered sample count applied at resolve.
+static std::vector<Eigen::Vector3f> legacy_ssaa(const scene& s)
+{
+    std::vector<std::vector<float>> depth(width * height);
+    std::vector<Eigen::Vector3f> color(width * height);
+    std::vector<Eigen::Vector3f> frame(width * height, Eigen::Vector3f{0, 0, 0});
+    std::vector<float> arr(4, std::numeric_limits<float>::infinity());
+    for (auto& item : depth)
+    {
+        item = arr;
+    }
+    std::fill(color.begin(), color.end(), Eigen::Vector3f{0, 0, 0});
+    auto index = [](int x, int y) { return (height - 1 - y) * width + x; };
+
+    float f1 = (50 - 0.1) / 2.0;
+    float f2 = (50 + 0.1) / 2.0;
+    for (const auto& tri : s.indices)
+    {
+        Eigen::Vector3f v[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            const auto& p = s.positions[tri[i]];
+            v[i] = {0.5f * width * (p.x() + 1.f), 0.5f * height * (p.y() + 1.f), p.z() * f1 + f2};
+        }
+        rst::triangle_setup setup;
+        if (!rst::setup_triangle(v, setup))
+        {
+            continue;
+        }
+        int x_begin = std::clamp<float>(std::floor(std::min({v[0].x(), v[1].x(), v[2].x()})), 0, width);
+        int x_end = std::clamp<float>(std::ceil(std::max({v[0].x(), v[1].x(), v[2].x()})), 0, width);
+        int y_begin = std::clamp<float>(std::floor(std::min({v[0].y(), v[1].y(), v[2].y()})), 0, height);
+        int y_end = std::clamp<float>(std::ceil(std::max({v[0].y(), v[1].y(), v[2].y()})), 0, height);
+
+        const float pos_list[4][2] = {{-0.25, -0.25}, {0.25, 0.25}, {-0.25, 0.25}, {0.25, -0.75}};
+        for (int y = y_begin; y < y_end; y++)
+        {
+            for (int x = x_begin; x < x_end; x++)
+            {
+                for (int i = 0; i < 4; i++)
+                {
+                    const auto& pos = pos_list[i];
+                    double e[3] = {setup.edge(0, x, y, pos[0], pos[1]), setup.edge(1, x, y, pos[0], pos[1]), setup.edge(2, x, y, pos[0], pos[1])};
+                    if (e[0] > 0 && e[1] > 0 && e[2] > 0)
+                    {
+                        auto [alpha, beta, gamma] = setup.barycentric(e);
+                        float z = alpha * v[0].z() + beta * v[1].z() + gamma * v[2].z();
+                        if (z < depth[index(x, y)][i])
+                        {
+                            depth[index(x, y)][i] = z;
+                            color[index(x, y)] = s.colors[tri[0]];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < width * height; ++i)
+    {
+        int count = std::count_if(depth[i].begin(), depth[i].end(), [](float z) { return z < std::numeric_limits<float>::infinity(); });
+        frame[i] = color[i] * (count / 4.f);
+    }
+    return frame;
+}
+
+static double mean_error(const std::vector<Eigen::Vector3f>& a, const std::vector<Eigen::Vector3f>& b)
+{
+    double sum = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        sum += (a[i] - b[i]).cwiseAbs().sum();
+    }
+    return sum / (3.0 * a.size());
+}
+
+// Known answer for the coverage of the sample patterns: a white square from pixel 0 to pixel 10.8
+// on both axes, as two triangles. Its resolved pixels must add up to the square's area, 116.64,
+// within what the samples along its two inner edges can miss.
+static bool check_coverage(rst::rasterizer& r, int samples)
+{
+    const float side = 10.8f;
+    float ndc = 2 * side / width - 1;
+    std::vector<Eigen::Vector3f> positions = {{-1, -1, 0}, {ndc, -1, 0}, {ndc, ndc, 0}, {-1, ndc, 0}};
+    std::vector<Eigen::Vector3i> indices = {{0, 1, 2}, {0, 2, 3}};
+    std::vector<Eigen::Vector3f> colors(4, Eigen::Vector3f(255, 255, 255));
+    auto pos_id = r.load_positions(positions);
+    auto ind_id = r.load_indices(indices);
+    auto col_id = r.load_colors(colors);
+
+    r.set_sample_count(samples);
+    r.clear(rst::Buffers::Color | rst::Buffers::Depth | rst::Buffers::Samples);
+    r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
+    double area = 0;
+    for (const auto& pixel : r.frame_buffer())
+    {
+        area += pixel.x() / 255;
+    }
+
+    // The patterns put one sample in every 1/samples wide column and row of the pixel, so each of the
+    // 11 pixels an inner edge crosses is off by at most one sample
+    double expected = side * side;
+    double tolerance = 2 * 11.0 / samples;
+    bool pass = std::abs(area - expected) <= tolerance;
+    printf("coverage MSAA %-3d %8.2f px, expected %.2f +- %.2f %s\n", samples, area, expected, tolerance, pass ? "" : "FAILED");
+    return pass;
+}
+
+int main()
+{
+    const int runs = 10;
+    scene s = random_scene(2000, 0.05f, 7);
+
+    rst::rasterizer r(width, height);
+    r.set_model(Eigen::Matrix4f::Identity());
+    r.set_view(Eigen::Matrix4f::Identity());
+    r.set_projection(Eigen::Matrix4f::Identity());
+    auto pos_id = r.load_positions(s.positions);
+    auto ind_id = r.load_indices(s.indices);
+    auto col_id = r.load_colors(s.colors);
+
+    auto render = [&](int samples, double* ms) {
+        r.set_sample_count(samples);
+        auto start = Clock::now();
+        for (int run = 0; run < runs; ++run)
+        {
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth | rst::Buffers::Samples);
+            r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
+            r.frame_buffer();
+        }
+        *ms = elapsed_ms(start) / runs;
+        return r.frame_buffer();
+    };
+
+    double reference_ms;
+    auto reference = render(16, &reference_ms);
+
+    printf("%d triangles, %dx%d, error is the mean absolute difference to 16x MSAA (0-255)\n",
+           (int)s.indices.size(), width, height);
+    printf("%-10s %10s %10s %12s\n", "mode", "frame(ms)", "error", "samples(MB)");
+
+    auto start = Clock::now();
+    std::vector<Eigen::Vector3f> legacy;
+    for (int run = 0; run < runs; ++run)
+    {
+        legacy = legacy_ssaa(s);
+    }
+    double legacy_ms = elapsed_ms(start) / runs;
+    double legacy_mb = width * height * (sizeof(std::vector<float>) + 4 * sizeof(float) + sizeof(Eigen::Vector3f)) / 1e6;
+    printf("%-10s %10.2f %10.3f %12.1f\n", "SSAA 4x", legacy_ms, mean_error(legacy, reference), legacy_mb);
+
+    for (int samples : {1, 2, 4, 8, 16})
+    {
+        double ms;
+        auto image = samples == 16 ? reference : render(samples, &ms);
+        if (samples == 16)
+        {
+            ms = reference_ms;
+        }
+        double mb = samples > 1 ? width * height * samples * (sizeof(float) + sizeof(Eigen::Vector3f)) / 1e6 : 0;
+        printf("MSAA %-5d %10.2f %10.3f %12.1f\n", samples, ms, mean_error(image, reference), mb);
+    }
+
+    bool covered = true;
+    for (int samples : {4, 16})
+    {
+        covered = check_coverage(r, samples) && covered;
+    }
+    return covered ? 0 : 1;
+}
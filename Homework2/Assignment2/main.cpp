@@ -1,4 +1,5 @@
 // clang-format off
+#include <cstdlib>
 #include <iostream>
 #include <opencv2/opencv.hpp>
 #include "rasterizer.hpp"
@@ -84,13 +85,21 @@ int main(int argc, const char** argv)
     bool command_line = false;
     std::string filename = "output.png";
 
-    if (argc == 2)
+    int samples = 1;
+
+    if (argc >= 2)
     {
         command_line = true;
         filename = std::string(argv[1]);
+        // Optional MSAA sample count: 1, 2, 4, 8 or 16
+        if (argc >= 3)
+        {
+            samples = std::atoi(argv[2]);
+        }
     }
 
     rst::rasterizer r(700, 700);
+    r.set_sample_count(samples);
 
     Eigen::Vector3f eye_pos = {0,0,5};
 
@@ -130,7 +139,7 @@ int main(int argc, const char** argv)
 
     if (command_line)
     {
-        r.clear(rst::Buffers::Color | rst::Buffers::Depth | rst::Buffers::SSAA_Depth);
+        r.clear(rst::Buffers::Color | rst::Buffers::Depth | rst::Buffers::Samples);
 
         r.set_model(get_model_matrix(angle));
         r.set_view(get_view_matrix(eye_pos));
@@ -148,7 +157,7 @@ int main(int argc, const char** argv)
 
     while(key != 27)
     {
-        r.clear(rst::Buffers::Color | rst::Buffers::Depth | rst::Buffers::SSAA_Depth);
+        r.clear(rst::Buffers::Color | rst::Buffers::Depth | rst::Buffers::Samples);
 
         r.set_model(get_model_matrix(angle));
         r.set_view(get_view_matrix(eye_pos));
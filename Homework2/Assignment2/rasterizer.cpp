@@ -7,12 +7,23 @@
 #include <limits>
 #include <vector>
 #include "rasterizer.hpp"
+#include "triangle_setup.hpp"
 #include <opencv2/opencv.hpp>
 #include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-
-
-#define SSAA false
+// Sample positions of the 1, 2, 4, 8 and 16x patterns, in 1/16 pixel relative to the pixel
+// position (the usual rotated / sparse grids). Multiples of 1/16 keep the snapped edge values exact.
+static const int sample_patterns[5][16][2] = {
+    {{0, 0}},
+    {{4, 4}, {-4, -4}},
+    {{-2, -6}, {6, -2}, {-6, 2}, {2, 6}},
+    {{1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}},
+    {{1, 1}, {-1, -3}, {-3, 2}, {4, -1}, {-5, -2}, {2, 5}, {5, 3}, {3, -5},
+     {-2, 6}, {0, -7}, {-4, -6}, {-6, 4}, {-8, 0}, {7, -4}, {6, 7}, {-7, -8}},
+};
 
 
 
@@ -46,52 +57,6 @@ auto to_vec4(const Eigen::Vector3f& v3, float w = 1.0f)
 }
 
 
-static bool insideTriangle(float x, float y, const Vector3f* _v)
-{   
-    // TODO : Implement this function to check if the point (x, y) is inside the triangle represented by _v[0], _v[1], _v[2]
-    // TODO : Implement this function to check if the point (x, y) is inside the triangle represented by _v[0], _v[1], _v[2]
-
-    const auto& point_a = _v[0];
-    const auto& point_b = _v[1];
-    const auto& point_c = _v[2];
-
-
-
-    Eigen::Vector3f point_p(x , y, point_a[2]);
-
-
-    auto& vector_pa = point_a - point_p;
-    auto& vector_pb = point_b - point_p;
-    auto& vector_pc = point_c - point_p;
-
-    auto& vector_ab = point_a - point_b;
-    auto& vector_bc = point_b - point_c;
-    auto& vector_ca = point_c - point_a;
-
-
-    auto pa_ab = vector_pa.cross(vector_ab);
-    auto pb_bc = vector_pb.cross(vector_bc);
-    auto pc_ca = vector_pc.cross(vector_ca);
-
-    // std::cout << "pa_ab: \n" << pa_ab << std::endl;
-    // std::cout << "pb_bc: \n" << pb_bc << std::endl;
-    // std::cout << "pc_ca: \n" << pc_ca << std::endl;
-
-    bool res = (pa_ab[2] > 0 && pb_bc[2] > 0 &&pc_ca[2] > 0) || ( (pa_ab[2] < 0 && pb_bc[2] < 0 &&pc_ca[2] < 0));
-
-    // std::cout << "res:" << res << std::endl;
-    return res;
-
-}
-
-static std::tuple<float, float, float> computeBarycentric2D(float x, float y, const Vector3f* v)
-{
-    float c1 = (x*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*y + v[1].x()*v[2].y() - v[2].x()*v[1].y()) / (v[0].x()*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*v[0].y() + v[1].x()*v[2].y() - v[2].x()*v[1].y());
-    float c2 = (x*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*y + v[2].x()*v[0].y() - v[0].x()*v[2].y()) / (v[1].x()*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*v[1].y() + v[2].x()*v[0].y() - v[0].x()*v[2].y());
-    float c3 = (x*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*y + v[0].x()*v[1].y() - v[1].x()*v[0].y()) / (v[2].x()*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*v[2].y() + v[0].x()*v[1].y() - v[1].x()*v[0].y());
-    return {c1,c2,c3};
-}
-
 void rst::rasterizer::draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type)
 {
     auto& buf = pos_buf[pos_buffer.pos_id];
@@ -141,29 +106,13 @@ void rst::rasterizer::draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf
     }
 
 
-    if(SSAA){
-        for (int x = 0; x < width; x++) 
-        {
-            for (int y = 0; y < height; y++)
-            {
-                const auto& ssaa_depth_list = ssaa_depth_buf[get_index(x, y)];
-                int count = 0;
-                for(const auto& item : ssaa_depth_list){
-                    if(item < std::numeric_limits<float>::infinity()){
-                        count++;
-                    }
-                }
-                Eigen::Vector3f point(x, y, 1);
-                const auto& color = ssaa_color_buf[get_index(x, y)];
-                set_pixel(point, color * (static_cast<float>(count) / 4.0));
-
-            }
-        }
+    if(sample_count > 1){
+        resolve_samples();
     }
 }
 void rst::rasterizer::GetBoundingBox(const Triangle &t, Eigen::Vector2f *bounding_box_x,
     Eigen::Vector2f *bounding_box_y){
-    float bounding_box_min = std::numeric_limits<float>::min();
+    float bounding_box_min = std::numeric_limits<float>::lowest();
     float bounding_box_max = std::numeric_limits<float>::max();
 
     // 初始化 bounding_box 的范围，初始化是无限
@@ -189,6 +138,12 @@ void rst::rasterizer::GetBoundingBox(const Triangle &t, Eigen::Vector2f *boundin
         }
     }
 
+    // Clamp to the framebuffer so the raster loops never leave it ({max, min} are pixel bounds).
+    (*bounding_box_x)[0] = std::clamp<float>((*bounding_box_x)[0], 0, width);
+    (*bounding_box_x)[1] = std::clamp<float>((*bounding_box_x)[1], 0, width);
+    (*bounding_box_y)[0] = std::clamp<float>((*bounding_box_y)[0], 0, height);
+    (*bounding_box_y)[1] = std::clamp<float>((*bounding_box_y)[1], 0, height);
+
     // std::cout << "(*bounding_box_x): " << (*bounding_box_x) << std::endl;
     // std::cout << "(*bounding_box_y): " << (*bounding_box_y) << std::endl;
 }
@@ -209,43 +164,39 @@ void rst::rasterizer::rasterize_triangle(const Triangle& t) {
     // std::cout << "GetBoundingBox bounding_box_y: " << bounding_box_y << std::endl;
 
 
-    Vector3f triangle_list[3];
-    triangle_list[0] = v[0].head<3>();
-    triangle_list[1] = v[1].head<3>();
-    triangle_list[2] = v[2].head<3>();
-
-
-    if(SSAA){
-        for(int x = std::floor(bounding_box_x[1]); x < std::ceil(bounding_box_x[0]); x++){
-            for(int y = std::floor(bounding_box_y[1]); y < std::ceil(bounding_box_y[0]); y++){
-                std::vector<std::vector<float>> pos_list = {{-0.25, -0.25},{0.25, 0.25},{-0.25, 0.25},{0.25, -0.75}};
-                for(int i = 0; i < 4; i++){
-                    const auto& pos = pos_list[i];
-                    bool res = insideTriangle(x + pos[0], y + pos[1] , triangle_list);
-                    if(res){
-                        auto[alpha, beta, gamma] = computeBarycentric2D(x + pos[0], y + pos[1], t.v);
-                        float w_reciprocal = 1.0/(alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
-                        float z_interpolated = alpha * v[0].z() / v[0].w() + beta * v[1].z() / v[1].w() + gamma * v[2].z() / v[2].w();
-                        z_interpolated *= w_reciprocal;
-                        if(z_interpolated < ssaa_depth_buf[get_index(x, y)][i]){
-                            ssaa_depth_buf[get_index(x, y)][i] = z_interpolated;
-                            ssaa_color_buf[get_index(x, y)] = t.getColor();
-                        }
-                    }
-                }
-                
+    triangle_setup setup;
+    if(!setup_triangle(t.v, setup)){
+        return;
+    }
+
+    int x_begin = std::floor(bounding_box_x[1]);
+    int x_end = std::ceil(bounding_box_x[0]);
+    int y_begin = std::floor(bounding_box_y[1]);
+    int y_end = std::ceil(bounding_box_y[0]);
+    if(sample_count > 1){
+        // Sample offsets reach half a pixel below the pixel position, so the pixel after the box's
+        // last one can still have samples inside the triangle.
+        x_end = std::min<int>(std::ceil(bounding_box_x[0] + 0.5f), width);
+        y_end = std::min<int>(std::ceil(bounding_box_y[0] + 0.5f), height);
+    }
+
+    for(int ty = y_begin / clear_tile; ty * clear_tile < y_end; ty++){
+        for(int tx = x_begin / clear_tile; tx * clear_tile < x_end; tx++){
+            if(tile_clears[ty * tiles_x + tx]){
+                materialize_tile(ty * tiles_x + tx, tile_clears[ty * tiles_x + tx]);
             }
         }
+    }
+
+    if(sample_count > 1){
+        rasterize_triangle_msaa(t, setup, x_begin, x_end, y_begin, y_end);
     }else{
-        for(int x = std::floor(bounding_box_x[1]); x < std::ceil(bounding_box_x[0]); x++){
-            for(int y = std::floor(bounding_box_y[1]); y < std::ceil(bounding_box_y[0]); y++){
-                bool res = insideTriangle(x, y, triangle_list);
-                if(res){
-                        auto[alpha, beta, gamma] = computeBarycentric2D(x, y, t.v);
-                        float w_reciprocal = 1.0/(alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
-                        float z_interpolated = alpha * v[0].z() / v[0].w() + beta * v[1].z() / v[1].w() + gamma * v[2].z() / v[2].w();
-                        z_interpolated *= w_reciprocal;
-                        // std::cout << "depth_buf[x * y]" << depth_buf[x * y] << std::endl;
+        for(int y = y_begin; y < y_end; y++){
+            double e[3] = {setup.edge(0, x_begin, y), setup.edge(1, x_begin, y), setup.edge(2, x_begin, y)};
+            for(int x = x_begin; x < x_end; x++, e[0] += setup.a[0], e[1] += setup.a[1], e[2] += setup.a[2]){
+                if(e[0] + setup.bias[0] > 0 && e[1] + setup.bias[1] > 0 && e[2] + setup.bias[2] > 0){
+                        auto[alpha, beta, gamma] = setup.barycentric(e);
+                        float z_interpolated = alpha * v[0].z() + beta * v[1].z() + gamma * v[2].z();
                         if(z_interpolated < depth_buf[get_index(x, y)]){
                             Eigen::Vector3f point(x, y, 1);
                             set_pixel(point, t.getColor());
@@ -261,15 +212,113 @@ void rst::rasterizer::rasterize_triangle(const Triangle& t) {
     // TODO : Find out the bounding box of current triangle.
     // iterate through the pixel and find if the current pixel is inside the triangle
 
-    // If so, use the following code to get the interpolated z value.
-    //auto[alpha, beta, gamma] = computeBarycentric2D(x, y, t.v);
-    //float w_reciprocal = 1.0/(alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
-    //float z_interpolated = alpha * v[0].z() / v[0].w() + beta * v[1].z() / v[1].w() + gamma * v[2].z() / v[2].w();
-    //z_interpolated *= w_reciprocal;
+    // If so, interpolate z from the edge-function barycentrics (toVector4() sets w to 1).
 
     // TODO : set the current pixel (use the set_pixel function) to the color of the triangle (use getColor function) if it should be painted.
 }
 
+// Multisampled inner loop: a coverage bit per sample from the edge values at the sample positions,
+// one color per covered pixel, and a depth test per covered sample.
+void rst::rasterizer::rasterize_triangle_msaa(const Triangle& t, const triangle_setup& setup,
+    int x_begin, int x_end, int y_begin, int y_end)
+{
+    auto v = t.toVector4();
+    const auto& pattern = sample_patterns[__builtin_ctz(sample_count)];
+
+    // Offset of every edge value from the pixel position to each sample position, and the same with
+    // the edge's bias for the coverage test.
+    double sample_edge[max_samples][3];
+    double sample_test[max_samples][3];
+    for(int s = 0; s < sample_count; s++){
+        for(int i = 0; i < 3; i++){
+            sample_edge[s][i] = setup.a[i] * (pattern[s][0] / 16.0) + setup.b[i] * (pattern[s][1] / 16.0);
+            sample_test[s][i] = sample_edge[s][i] + setup.bias[i];
+        }
+    }
+
+    int plane = width * height;
+    for(int y = y_begin; y < y_end; y++){
+        double e[3] = {setup.edge(0, x_begin, y), setup.edge(1, x_begin, y), setup.edge(2, x_begin, y)};
+        for(int x = x_begin; x < x_end; x++, e[0] += setup.a[0], e[1] += setup.a[1], e[2] += setup.a[2]){
+            unsigned coverage = 0;
+            for(int s = 0; s < sample_count; s++){
+                bool inside = e[0] + sample_test[s][0] > 0 && e[1] + sample_test[s][1] > 0 && e[2] + sample_test[s][2] > 0;
+                coverage |= (unsigned)inside << s;
+            }
+            if(!coverage){
+                continue;
+            }
+
+            int index = get_index(x, y);
+            Eigen::Vector3f color = t.getColor();
+            for(; coverage; coverage &= coverage - 1){
+                int s = __builtin_ctz(coverage);
+                double es[3] = {e[0] + sample_edge[s][0], e[1] + sample_edge[s][1], e[2] + sample_edge[s][2]};
+                auto[alpha, beta, gamma] = setup.barycentric(es);
+                float z_interpolated = alpha * v[0].z() + beta * v[1].z() + gamma * v[2].z();
+                if(z_interpolated < sample_depth_buf[s * plane + index]){
+                    sample_depth_buf[s * plane + index] = z_interpolated;
+                    sample_color_buf[s * plane + index] = color;
+                }
+            }
+        }
+    }
+}
+
+// Averages the samples of every pixel into frame_buf, a row of a tile at a time. Each sample plane
+// is read as a contiguous run of floats, four at a time with SSE2. Tiles whose samples are still
+// cleared resolve to the clear color, so their color is marked cleared instead.
+void rst::rasterizer::resolve_samples()
+{
+    int plane = width * height;
+    float scale = 1.f / sample_count;
+    for(int tile = 0; tile < (int)tile_clears.size(); tile++){
+        if(tile_clears[tile] & (int)Buffers::Samples){
+            tile_clears[tile] |= (int)Buffers::Color;
+            color_clears_pending = true;
+            continue;
+        }
+        tile_clears[tile] &= ~(int)Buffers::Color;
+
+        int x0 = tile % tiles_x * clear_tile, x1 = std::min(width, x0 + clear_tile);
+        int y0 = tile / tiles_x * clear_tile, y1 = std::min(height, y0 + clear_tile);
+        for(int y = y0; y < y1; y++){
+            int index = get_index(x0, y);
+            const float* samples = sample_color_buf[index].data();
+            float* out = frame_buf[index].data();
+            int count = 3 * (x1 - x0);
+            int k = 0;
+#if defined(__SSE2__)
+            for(; k + 4 <= count; k += 4){
+                __m128 sum = _mm_loadu_ps(samples + k);
+                for(int s = 1; s < sample_count; s++){
+                    sum = _mm_add_ps(sum, _mm_loadu_ps(samples + 3 * s * plane + k));
+                }
+                _mm_storeu_ps(out + k, _mm_mul_ps(sum, _mm_set1_ps(scale)));
+            }
+#endif
+            for(; k < count; k++){
+                float sum = samples[k];
+                for(int s = 1; s < sample_count; s++){
+                    sum += samples[3 * s * plane + k];
+                }
+                out[k] = sum * scale;
+            }
+        }
+    }
+}
+
+void rst::rasterizer::set_sample_count(int count)
+{
+    sample_count = 1;
+    while(sample_count * 2 <= std::min(count, max_samples)){
+        sample_count *= 2;
+    }
+    int samples = sample_count > 1 ? sample_count * width * height : 0;
+    sample_depth_buf.assign(samples, std::numeric_limits<float>::infinity());
+    sample_color_buf.assign(samples, Eigen::Vector3f{0, 0, 0});
+}
+
 void rst::rasterizer::set_model(const Eigen::Matrix4f& m)
 {
     model = m;
@@ -287,30 +336,69 @@ void rst::rasterizer::set_projection(const Eigen::Matrix4f& p)
 
 void rst::rasterizer::clear(rst::Buffers buff)
 {
+    for (auto& flags : tile_clears)
+    {
+        flags |= (int)buff;
+    }
     if ((buff & rst::Buffers::Color) == rst::Buffers::Color)
     {
-        std::fill(frame_buf.begin(), frame_buf.end(), Eigen::Vector3f{0, 0, 0});
+        color_clears_pending = true;
     }
-    if ((buff & rst::Buffers::Depth) == rst::Buffers::Depth)
+}
+
+// Fills the given buffers (bits of Buffers) of one tile with their clear values and unmarks them.
+void rst::rasterizer::materialize_tile(int tile, int buffers)
+{
+    tile_clears[tile] &= ~buffers;
+    int x0 = tile % tiles_x * clear_tile, x1 = std::min(width, x0 + clear_tile);
+    int y0 = tile / tiles_x * clear_tile, y1 = std::min(height, y0 + clear_tile);
+    for (int y = y0; y < y1; y++)
     {
-        std::fill(depth_buf.begin(), depth_buf.end(), std::numeric_limits<float>::infinity());
+        int index = get_index(x0, y);
+        if (buffers & (int)Buffers::Color)
+        {
+            std::fill_n(&frame_buf[index], x1 - x0, Eigen::Vector3f{0, 0, 0});
+        }
+        if (buffers & (int)Buffers::Depth)
+        {
+            std::fill_n(&depth_buf[index], x1 - x0, std::numeric_limits<float>::infinity());
+        }
+        if ((buffers & (int)Buffers::Samples) && sample_count > 1)
+        {
+            for (int s = 0; s < sample_count; s++)
+            {
+                int sample_index = s * width * height + index;
+                std::fill_n(&sample_depth_buf[sample_index], x1 - x0, std::numeric_limits<float>::infinity());
+                std::fill_n(&sample_color_buf[sample_index], x1 - x0, Eigen::Vector3f{0, 0, 0});
+            }
+        }
+    }
+}
+
+// Fills the color of the tiles nothing was drawn to since the last clear, before the frame is read.
+void rst::rasterizer::resolve_clears()
+{
+    if (!color_clears_pending)
+    {
+        return;
     }
-    if ((buff & rst::Buffers::SSAA_Depth) == rst::Buffers::SSAA_Depth)
+    for (int tile = 0; tile < (int)tile_clears.size(); tile++)
     {
-        std::vector<float> arr(4, std::numeric_limits<float>::infinity());
-        for(auto& item : ssaa_depth_buf){
-            item = arr;
+        if (tile_clears[tile] & (int)Buffers::Color)
+        {
+            materialize_tile(tile, (int)Buffers::Color);
         }
-        std::fill(ssaa_color_buf.begin(), ssaa_color_buf.end(), Eigen::Vector3f{0, 0, 0});
     }
+    color_clears_pending = false;
 }
 
 rst::rasterizer::rasterizer(int w, int h) : width(w), height(h)
 {
     frame_buf.resize(w * h);
     depth_buf.resize(w * h);
-    ssaa_depth_buf.resize(w * h);
-    ssaa_color_buf.resize(w *h);
+
+    tiles_x = (w + clear_tile - 1) / clear_tile;
+    tile_clears.resize(tiles_x * ((h + clear_tile - 1) / clear_tile));
 }
 
 int rst::rasterizer::get_index(int x, int y)
@@ -322,6 +410,10 @@ void rst::rasterizer::set_pixel(const Eigen::Vector3f& point, const Eigen::Vecto
 {
     //old index: auto ind = point.y() + point.x() * width;
     auto ind = (height-1-point.y())*width + point.x();
+    int tile = get_tile(point.x(), point.y());
+    if(tile_clears[tile]){
+        materialize_tile(tile, tile_clears[tile]);
+    }
     // std::cout << "y,x :  (" << (height-1-point.y()) << "," << point.x()  << ")" << "color" << color << std::endl; 
     frame_buf[ind] = color;
 
@@ -6,13 +6,16 @@
 
 #include "Triangle.hpp"
 #include "global.hpp"
+#include "triangle_setup.hpp"
 #include <algorithm>
+#include <cstdint>
 #include <eigen3/Eigen/Eigen>
 #include <vector>
 using namespace Eigen;
 
 namespace rst {
-enum class Buffers { Color = 1, Depth = 2, SSAA_Depth = 4 };
+// Samples are the per-sample depth and color buffers of multisampling (set_sample_count).
+enum class Buffers { Color = 1, Depth = 2, Samples = 4 };
 
 inline Buffers operator|(Buffers a, Buffers b) {
   return Buffers((int)a | (int)b);
@@ -54,17 +57,30 @@ public:
 
   void set_pixel(const Eigen::Vector3f &point, const Eigen::Vector3f &color);
 
+  // Multisample anti-aliasing with 1 (off), 2, 4, 8 or 16 samples per pixel; other counts are
+  // rounded down to one of these. Coverage and depth are tested per sample, the color is computed
+  // once per pixel and stored to the covered samples, and draw() resolves the samples into the
+  // frame buffer.
+  void set_sample_count(int count);
+
+  // Marks the buffers as cleared; see tile_clears for when the memory is actually written.
   void clear(Buffers buff);
 
   void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer,
             Primitive type);
 
-  std::vector<Eigen::Vector3f> &frame_buffer() { return frame_buf; }
+  std::vector<Eigen::Vector3f> &frame_buffer() {
+    resolve_clears();
+    return frame_buf;
+  }
 
 private:
   void draw_line(Eigen::Vector3f begin, Eigen::Vector3f end);
 
   void rasterize_triangle(const Triangle &t);
+  void rasterize_triangle_msaa(const Triangle &t, const triangle_setup &setup,
+                               int x_begin, int x_end, int y_begin, int y_end);
+  void resolve_samples();
 
   void GetBoundingBox(const Triangle &t, Eigen::Vector2f *bounding_box_x,
                       Eigen::Vector2f *bounding_box_y);
@@ -84,8 +100,25 @@ private:
   std::vector<Eigen::Vector3f> frame_buf;
 
   std::vector<float> depth_buf;
-  std::vector<std::vector<float>> ssaa_depth_buf;
-  std::vector<Eigen::Vector3f> ssaa_color_buf;
+
+  // Sample-major multisample buffers: sample s of pixel index is at s * width * height + index,
+  // so every sample is a full-frame plane. Empty when sample_count is 1.
+  static constexpr int max_samples = 16;
+  int sample_count = 1;
+  std::vector<float> sample_depth_buf;
+  std::vector<Eigen::Vector3f> sample_color_buf;
+
+  // Fast clear: clear() only sets the cleared buffers' bits (as in Buffers) on every
+  // clear_tile x clear_tile tile instead of filling the buffers. A triangle fills the tiles its
+  // bounding box overlaps with the clear values before drawing, and the color of tiles still
+  // marked is filled when the frame buffer is read.
+  static constexpr int clear_tile = 8;
+  std::vector<uint8_t> tile_clears;
+  int tiles_x;
+  bool color_clears_pending = false;
+  int get_tile(int x, int y) { return y / clear_tile * tiles_x + x / clear_tile; }
+  void materialize_tile(int tile, int buffers);
+  void resolve_clears();
 
   int get_index(int x, int y);
 
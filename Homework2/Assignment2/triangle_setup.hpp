@@ -0,0 +1,89 @@
+//
+// Triangle setup for the edge-function rasterizer.
+//
+
+#ifndef RASTERIZER_TRIANGLE_SETUP_H
+#define RASTERIZER_TRIANGLE_SETUP_H
+
+#include <eigen3/Eigen/Eigen>
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+namespace rst
+{
+    // Vertices are snapped to 1/256 pixel before the edge equations are built. With that precision
+    // every edge value is an integer well below 2^53, so it is held exactly in a double and stepping
+    // from pixel to pixel by adding a[i] / b[i] never accumulates rounding error.
+    constexpr int subpixel_bits = 8;
+    constexpr double subpixel_scale = 1 << subpixel_bits;
+
+    struct triangle_setup
+    {
+        // E_i(x, y) = a[i] * x + b[i] * y + c[i] for the edge opposite vertex i, evaluated at integer
+        // pixel positions. Signs are normalized so all three are positive inside the triangle.
+        double a[3];
+        double b[3];
+        double c[3];
+
+        // 1 for the edges that own the positions exactly on them, else 0. A position is inside when
+        // E_i + bias[i] > 0 for all three edges. An edge shared by two triangles faces opposite ways in
+        // each, so exactly one of them owns it and its positions are covered once, never by neither.
+        double bias[3];
+
+        // E_i / (E_0 + E_1 + E_2) is the barycentric weight of vertex i.
+        double inv_area;
+
+        double edge(int i, int x, int y) const { return a[i] * x + b[i] * y + c[i]; }
+
+        // Same as edge(), at a fractional offset from the pixel (used for multisample positions).
+        double edge(int i, int x, int y, float dx, float dy) const
+        {
+            return edge(i, x, y) + (a[i] * dx + b[i] * dy);
+        }
+
+        std::tuple<float, float, float> barycentric(const double* e) const
+        {
+            return {(float)(e[0] * inv_area), (float)(e[1] * inv_area), (float)(e[2] * inv_area)};
+        }
+    };
+
+    // Builds the edge equations of the screen-space triangle v[0..2]. Returns false for degenerate
+    // (zero-area) triangles, which cover no pixels.
+    template <typename Vec>
+    bool setup_triangle(const Vec* v, triangle_setup& s)
+    {
+        double px[3], py[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            px[i] = std::round((double)v[i].x() * subpixel_scale);
+            py[i] = std::round((double)v[i].y() * subpixel_scale);
+        }
+
+        double area = (px[1] - px[0]) * (py[2] - py[0]) - (py[1] - py[0]) * (px[2] - px[0]);
+        if (area == 0)
+        {
+            return false;
+        }
+        double sign = area > 0 ? 1.0 : -1.0;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            int j = (i + 1) % 3;
+            int k = (i + 2) % 3;
+            // Edge j -> k, scaled so a unit step in pixels is a step of subpixel_scale in fixed point.
+            double dx = px[k] - px[j];
+            double dy = py[k] - py[j];
+            s.a[i] = -dy * subpixel_scale * sign;
+            s.b[i] = dx * subpixel_scale * sign;
+            s.c[i] = (dy * px[j] - dx * py[j]) * sign;
+            // Edge values are integers, so a bias of 1 makes E_i + bias > 0 the same as E_i >= 0.
+            // Owned are the edges whose inward normal points to +x, or to +y when horizontal.
+            s.bias[i] = s.a[i] > 0 || (s.a[i] == 0 && s.b[i] > 0) ? 1 : 0;
+        }
+        s.inv_area = 1.0 / std::abs(area);
+        return true;
+    }
+}
+
+#endif //RASTERIZER_TRIANGLE_SETUP_H
@@ -16,8 +16,20 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <math.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 // Print progress to console while loading (large models)
 #define OBJL_CONSOLE_OUTPUT
@@ -224,7 +236,7 @@ namespace objl
     namespace math
     {
         // Vector3 Cross Product
-        Vector3 CrossV3(const Vector3 a, const Vector3 b)
+        inline Vector3 CrossV3(const Vector3 a, const Vector3 b)
         {
             return Vector3(a.Y * b.Z - a.Z * b.Y,
                            a.Z * b.X - a.X * b.Z,
@@ -232,19 +244,19 @@ namespace objl
         }
 
         // Vector3 Magnitude Calculation
-        float MagnitudeV3(const Vector3 in)
+        inline float MagnitudeV3(const Vector3 in)
         {
             return (sqrtf(powf(in.X, 2) + powf(in.Y, 2) + powf(in.Z, 2)));
         }
 
         // Vector3 DotProduct
-        float DotV3(const Vector3 a, const Vector3 b)
+        inline float DotV3(const Vector3 a, const Vector3 b)
         {
             return (a.X * b.X) + (a.Y * b.Y) + (a.Z * b.Z);
         }
 
         // Angle between 2 Vector3 Objects
-        float AngleBetweenV3(const Vector3 a, const Vector3 b)
+        inline float AngleBetweenV3(const Vector3 a, const Vector3 b)
         {
             float angle = DotV3(a, b);
             angle /= (MagnitudeV3(a) * MagnitudeV3(b));
@@ -252,7 +264,7 @@ namespace objl
         }
 
         // Projection Calculation of a onto b
-        Vector3 ProjV3(const Vector3 a, const Vector3 b)
+        inline Vector3 ProjV3(const Vector3 a, const Vector3 b)
         {
             Vector3 bn = b / MagnitudeV3(b);
             return bn * DotV3(a, bn);
@@ -266,13 +278,13 @@ namespace objl
     namespace algorithm
     {
         // Vector3 Multiplication Opertor Overload
-        Vector3 operator*(const float& left, const Vector3& right)
+        inline Vector3 operator*(const float& left, const Vector3& right)
         {
             return Vector3(right.X * left, right.Y * left, right.Z * left);
         }
 
         // A test to see if P1 is on the same side as P2 of a line segment ab
-        bool SameSide(Vector3 p1, Vector3 p2, Vector3 a, Vector3 b)
+        inline bool SameSide(Vector3 p1, Vector3 p2, Vector3 a, Vector3 b)
         {
             Vector3 cp1 = math::CrossV3(b - a, p1 - a);
             Vector3 cp2 = math::CrossV3(b - a, p2 - a);
@@ -284,7 +296,7 @@ namespace objl
         }
 
         // Generate a cross produect normal for a triangle
-        Vector3 GenTriNormal(Vector3 t1, Vector3 t2, Vector3 t3)
+        inline Vector3 GenTriNormal(Vector3 t1, Vector3 t2, Vector3 t3)
         {
             Vector3 u = t2 - t1;
             Vector3 v = t3 - t1;
@@ -295,7 +307,7 @@ namespace objl
         }
 
         // Check to see if a Vector3 Point is within a 3 Vector3 Triangle
-        bool inTriangle(Vector3 point, Vector3 tri1, Vector3 tri2, Vector3 tri3)
+        inline bool inTriangle(Vector3 point, Vector3 tri1, Vector3 tri2, Vector3 tri3)
         {
             // Test to see if it is within an infinite prism that the triangle outlines.
             bool within_tri_prisim = SameSide(point, tri1, tri2, tri3) && SameSide(point, tri2, tri1, tri3)
@@ -406,8 +418,220 @@ namespace objl
                 idx--;
             return elements[idx];
         }
+
+        // string_view versions of the above for the LoadFile parser, which never copies a line.
+
+        // The find_first_of family tests every character against the whole set through
+        //	char_traits, which dominates a parse of a large file; these scan the view directly.
+
+        inline bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+        // Offset of the first character at or after start that is (blank == true) or is not a
+        //	space or tab, size() when there is none
+        inline size_t scanBlank(std::string_view in, size_t start, bool blank)
+        {
+            while (start < in.size() && isBlank(in[start]) != blank)
+                start++;
+            return start;
+        }
+
+        // First token of in, delimited by spaces and tabs
+        inline std::string_view firstTokenView(std::string_view in)
+        {
+            size_t token_start = scanBlank(in, 0, false);
+            size_t token_end = scanBlank(in, token_start, true);
+            return in.substr(token_start, token_end - token_start);
+        }
+
+        // Same as tail()
+        inline std::string_view tailView(std::string_view in)
+        {
+            size_t tail_start = scanBlank(in, scanBlank(in, scanBlank(in, 0, false), true), false);
+            size_t tail_end = in.size();
+            while (tail_end > tail_start && isBlank(in[tail_end - 1]))
+                tail_end--;
+            return in.substr(tail_start, tail_end - tail_start);
+        }
+
+        // Removes and returns the next field of in; fields are separated by spaces, tabs or a
+        //	carriage return.
+        inline std::string_view nextField(std::string_view& in)
+        {
+            size_t start = 0;
+            while (start < in.size() && (isBlank(in[start]) || in[start] == '\r'))
+                start++;
+            size_t end = start;
+            while (end < in.size() && !isBlank(in[end]) && in[end] != '\r')
+                end++;
+            std::string_view field = in.substr(start, end - start);
+            in.remove_prefix(end);
+            return field;
+        }
+
+        // Parses a float like std::stof; 0 when the text is not a number.
+        inline float parseFloat(std::string_view in)
+        {
+            if (!in.empty() && in[0] == '+')
+                in.remove_prefix(1);
+            float value = 0;
+#if defined(__cpp_lib_to_chars)
+            std::from_chars(in.data(), in.data() + in.size(), value);
+#else
+            char buffer[64];
+            size_t size = std::min(in.size(), sizeof(buffer) - 1);
+            std::memcpy(buffer, in.data(), size);
+            buffer[size] = 0;
+            value = std::strtof(buffer, nullptr);
+#endif
+            return value;
+        }
+
+        // Same as getElement(), with the index as a string_view
+        template <class T>
+        inline const T & getElement(const std::vector<T> &elements, std::string_view index)
+        {
+            if (!index.empty() && index[0] == '+')
+                index.remove_prefix(1);
+            int idx = 0;
+            std::from_chars(index.data(), index.data() + index.size(), idx);
+            if (idx < 0)
+                idx = int(elements.size()) + idx;
+            else
+                idx--;
+            return elements[idx];
+        }
     }
 
+    // Class: MappedFile
+    //
+    // Description: Read-only view of a whole file, memory mapped where
+    //	the platform supports it and read into memory otherwise
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::string& path)
+        {
+#if defined(__unix__) || defined(__APPLE__)
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return;
+            struct stat info;
+            if (fstat(fd, &info) == 0)
+            {
+                opened = true;
+                size = info.st_size;
+                if (size > 0)
+                {
+                    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (mapped != MAP_FAILED)
+                    {
+                        madvise(mapped, size, MADV_SEQUENTIAL);
+                        data = static_cast<const char*>(mapped);
+                    }
+                    else
+                    {
+                        opened = false;
+                    }
+                }
+            }
+            close(fd);
+#else
+            std::ifstream file(path, std::ios::binary);
+            if (!file.is_open())
+                return;
+            opened = true;
+            contents.assign(std::istreambuf_iterator<char>(file), {});
+            data = contents.data();
+            size = contents.size();
+#endif
+        }
+
+        ~MappedFile()
+        {
+#if defined(__unix__) || defined(__APPLE__)
+            if (data)
+                munmap(const_cast<char*>(data), size);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool IsOpen() const { return opened; }
+        std::string_view View() const { return std::string_view(data, data ? size : 0); }
+
+    private:
+        bool opened = false;
+        const char* data = nullptr;
+        size_t size = 0;
+#if !(defined(__unix__) || defined(__APPLE__))
+        std::string contents;
+#endif
+    };
+
+    // Class: VertexTable
+    //
+    // Description: Hash set of the vertices of one mesh, keyed by
+    //	their bytes, used to weld face corners that share position,
+    //	texture coordinate and normal into one indexed vertex
+    class VertexTable
+    {
+    public:
+        // Index of iVert in oVerts, appending it if it is not there yet
+        unsigned int Insert(std::vector<Vertex>& oVerts, const Vertex& iVert)
+        {
+            if (2 * (oVerts.size() + 1) > slots.size())
+                Grow(oVerts);
+
+            size_t mask = slots.size() - 1;
+            for (size_t slot = Hash(iVert) & mask;; slot = (slot + 1) & mask)
+            {
+                if (slots[slot] == 0)
+                {
+                    oVerts.push_back(iVert);
+                    slots[slot] = (unsigned int)oVerts.size();
+                    return slots[slot] - 1;
+                }
+                if (std::memcmp(&oVerts[slots[slot] - 1], &iVert, sizeof(Vertex)) == 0)
+                    return slots[slot] - 1;
+            }
+        }
+
+        // Forget every vertex, for the next mesh
+        void Clear()
+        {
+            std::fill(slots.begin(), slots.end(), 0);
+        }
+
+    private:
+        static size_t Hash(const Vertex& iVert)
+        {
+            uint32_t words[sizeof(Vertex) / 4];
+            std::memcpy(words, &iVert, sizeof(Vertex));
+            uint64_t hash = 0;
+            for (uint32_t word : words)
+                hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+            return size_t(hash ^ (hash >> 32));
+        }
+
+        // Doubles the table and inserts the vertices of oVerts again
+        void Grow(const std::vector<Vertex>& oVerts)
+        {
+            slots.assign(std::max<size_t>(64, 2 * slots.size()), 0);
+            size_t mask = slots.size() - 1;
+            for (size_t i = 0; i < oVerts.size(); i++)
+            {
+                size_t slot = Hash(oVerts[i]) & mask;
+                while (slots[slot] != 0)
+                    slot = (slot + 1) & mask;
+                slots[slot] = (unsigned int)i + 1;
+            }
+        }
+
+        // Index + 1 of the vertex in each slot, 0 when empty
+        std::vector<unsigned int> slots;
+    };
+
     // Class: Loader
     //
     // Description: The OBJ Model Loader
@@ -430,7 +654,257 @@ namespace objl
         //
         // If the file is unable to be found
         // or unable to be loaded return false
+        //
+        // The file is memory mapped and parsed in place: lines and
+        //	fields are string_views, numbers are read with from_chars
+        //	and the arrays are sized by a first pass over the file.
+        //	The result is the same as LoadFileStream's unless
+        //	DeduplicateVertices is set.
         bool LoadFile(std::string Path)
+        {
+            // If the file is not an .obj file return false
+            if (Path.size() < 4 || Path.substr(Path.size() - 4, 4) != ".obj")
+                return false;
+
+            MappedFile file(Path);
+
+            if (!file.IsOpen())
+                return false;
+
+            LoadedMeshes.clear();
+            LoadedVertices.clear();
+            LoadedIndices.clear();
+
+            std::string_view text = file.View();
+            auto forEachLine = [&text](auto&& visit)
+            {
+                size_t start = 0;
+                while (start < text.size())
+                {
+                    const char* newline = static_cast<const char*>(std::memchr(text.data() + start, '\n', text.size() - start));
+                    size_t end = newline ? newline - text.data() : text.size();
+                    visit(text.substr(start, end - start));
+                    start = end + 1;
+                }
+            };
+
+            // Count records to allocate everything once
+            size_t positionCount = 0, tcoordCount = 0, normalCount = 0, faceCount = 0;
+            forEachLine([&](std::string_view line)
+            {
+                std::string_view first = algorithm::firstTokenView(line);
+                positionCount += first == "v";
+                tcoordCount += first == "vt";
+                normalCount += first == "vn";
+                faceCount += first == "f";
+            });
+
+            std::vector<Vector3> Positions;
+            std::vector<Vector2> TCoords;
+            std::vector<Vector3> Normals;
+            Positions.reserve(positionCount);
+            TCoords.reserve(tcoordCount);
+            Normals.reserve(normalCount);
+
+            std::vector<Vertex> Vertices;
+            std::vector<unsigned int> Indices;
+            Indices.reserve(3 * faceCount);
+            LoadedIndices.reserve(3 * faceCount);
+            // Welded meshes grow as they find new vertices
+            if (!DeduplicateVertices)
+            {
+                Vertices.reserve(3 * faceCount);
+                LoadedVertices.reserve(3 * faceCount);
+            }
+            VertexTable table;
+
+            std::vector<std::string> MeshMatNames;
+
+            bool listening = false;
+            std::string meshname;
+
+            // Vertices and triangulation of the current face, reused from face to face
+            std::vector<Vertex> vVerts;
+            std::vector<unsigned int> iIndices;
+
+            auto pushMesh = [&](std::string name)
+            {
+                // Welded vertices reach the loader-wide arrays a mesh at a time
+                if (DeduplicateVertices)
+                {
+                    unsigned int offset = (unsigned int)LoadedVertices.size();
+                    LoadedVertices.insert(LoadedVertices.end(), Vertices.begin(), Vertices.end());
+                    for (unsigned int index : Indices)
+                        LoadedIndices.push_back(offset + index);
+                    table.Clear();
+                }
+                LoadedMeshes.emplace_back();
+                LoadedMeshes.back().Vertices = std::move(Vertices);
+                LoadedMeshes.back().Indices = std::move(Indices);
+                LoadedMeshes.back().MeshName = std::move(name);
+                Vertices.clear();
+                Indices.clear();
+            };
+
+#ifdef OBJL_CONSOLE_OUTPUT
+            const unsigned int outputEveryNth = 1000;
+            unsigned int outputIndicator = outputEveryNth;
+#endif
+
+            forEachLine([&](std::string_view curline)
+            {
+#ifdef OBJL_CONSOLE_OUTPUT
+                if ((outputIndicator = ((outputIndicator + 1) % outputEveryNth)) == 1)
+                {
+                    if (!meshname.empty())
+                    {
+                        std::cout
+                                << "\r- " << meshname
+                                << "\t| vertices > " << Positions.size()
+                                << "\t| texcoords > " << TCoords.size()
+                                << "\t| normals > " << Normals.size()
+                                << "\t| triangles > " << (Vertices.size() / 3)
+                                << (!MeshMatNames.empty() ? "\t| material: " + MeshMatNames.back() : "");
+                    }
+                }
+#endif
+                std::string_view first = algorithm::firstTokenView(curline);
+
+                // Generate a Mesh Object or Prepare for an object to be created
+                if (first == "o" || first == "g" || (!curline.empty() && curline[0] == 'g'))
+                {
+                    bool named = first == "o" || first == "g";
+                    if (listening && !Indices.empty() && !Vertices.empty())
+                    {
+                        pushMesh(std::move(meshname));
+                        meshname = algorithm::tailView(curline);
+                    }
+                    else
+                    {
+                        listening = true;
+                        meshname = named ? std::string(algorithm::tailView(curline)) : "unnamed";
+                    }
+#ifdef OBJL_CONSOLE_OUTPUT
+                    outputIndicator = 0;
+#endif
+                }
+                // Generate a Vertex Position
+                else if (first == "v")
+                {
+                    std::string_view fields = algorithm::tailView(curline);
+                    Vector3 vpos;
+                    vpos.X = algorithm::parseFloat(algorithm::nextField(fields));
+                    vpos.Y = algorithm::parseFloat(algorithm::nextField(fields));
+                    vpos.Z = algorithm::parseFloat(algorithm::nextField(fields));
+                    Positions.push_back(vpos);
+                }
+                // Generate a Vertex Texture Coordinate
+                else if (first == "vt")
+                {
+                    std::string_view fields = algorithm::tailView(curline);
+                    Vector2 vtex;
+                    vtex.X = algorithm::parseFloat(algorithm::nextField(fields));
+                    vtex.Y = algorithm::parseFloat(algorithm::nextField(fields));
+                    TCoords.push_back(vtex);
+                }
+                // Generate a Vertex Normal;
+                else if (first == "vn")
+                {
+                    std::string_view fields = algorithm::tailView(curline);
+                    Vector3 vnor;
+                    vnor.X = algorithm::parseFloat(algorithm::nextField(fields));
+                    vnor.Y = algorithm::parseFloat(algorithm::nextField(fields));
+                    vnor.Z = algorithm::parseFloat(algorithm::nextField(fields));
+                    Normals.push_back(vnor);
+                }
+                // Generate a Face (vertices & indices)
+                else if (first == "f")
+                {
+                    vVerts.clear();
+                    GenVerticesFromFaceView(vVerts, Positions, TCoords, Normals, algorithm::tailView(curline));
+
+                    iIndices.clear();
+                    VertexTriangluation(iIndices, vVerts);
+
+                    if (DeduplicateVertices)
+                    {
+                        for (unsigned int index : iIndices)
+                            Indices.push_back(table.Insert(Vertices, vVerts[index]));
+                        return;
+                    }
+
+                    Vertices.insert(Vertices.end(), vVerts.begin(), vVerts.end());
+                    LoadedVertices.insert(LoadedVertices.end(), vVerts.begin(), vVerts.end());
+
+                    for (unsigned int index : iIndices)
+                    {
+                        Indices.push_back((unsigned int)(Vertices.size() - vVerts.size()) + index);
+                        LoadedIndices.push_back((unsigned int)(LoadedVertices.size() - vVerts.size()) + index);
+                    }
+                }
+                // Get Mesh Material Name
+                else if (first == "usemtl")
+                {
+                    MeshMatNames.emplace_back(algorithm::tailView(curline));
+
+                    // Create new Mesh, if Material changes within a group
+                    if (!Indices.empty() && !Vertices.empty())
+                        pushMesh(meshname + "_2");
+
+#ifdef OBJL_CONSOLE_OUTPUT
+                    outputIndicator = 0;
+#endif
+                }
+                // Load Materials
+                else if (first == "mtllib")
+                {
+                    // Generate a path to the material file
+                    std::vector<std::string> temp;
+                    algorithm::split(Path, temp, "/");
+
+                    std::string pathtomat = "";
+
+                    if (temp.size() != 1)
+                    {
+                        for (size_t i = 0; i < temp.size() - 1; i++)
+                        {
+                            pathtomat += temp[i] + "/";
+                        }
+                    }
+
+                    pathtomat += algorithm::tailView(curline);
+
+                    // Load Materials
+                    LoadMaterials(pathtomat);
+                }
+            });
+
+            // Deal with last mesh
+            if (!Indices.empty() && !Vertices.empty())
+                pushMesh(std::move(meshname));
+
+            // Set Materials for each Mesh
+            for (size_t i = 0; i < MeshMatNames.size(); i++)
+            {
+                // Find corresponding material name in loaded materials
+                // when found copy material variables into mesh material
+                for (size_t j = 0; j < LoadedMaterials.size(); j++)
+                {
+                    if (LoadedMaterials[j].name == MeshMatNames[i])
+                    {
+                        LoadedMeshes[i].MeshMaterial = LoadedMaterials[j];
+                        break;
+                    }
+                }
+            }
+
+            return !(LoadedMeshes.empty() && LoadedVertices.empty() && LoadedIndices.empty());
+        }
+
+        // The original loader: reads the file line by line through
+        //	std::ifstream and splits every line into strings. Kept as
+        //	the reference LoadFile is checked against.
+        bool LoadFileStream(std::string Path)
         {
             // If the file is not an .obj file return false
             if (Path.substr(Path.size() - 4, 4) != ".obj")
@@ -714,6 +1188,11 @@ namespace objl
             }
         }
 
+        // Weld identical corners in LoadFile: each mesh then holds
+        //	every distinct vertex once, in order of first use, and
+        //	its Indices reference them, three per triangle
+        bool DeduplicateVertices = false;
+
         // Loaded Mesh Objects
         std::vector<Mesh> LoadedMeshes;
         // Loaded Vertex Objects
@@ -724,6 +1203,58 @@ namespace objl
         std::vector<Material> LoadedMaterials;
 
     private:
+        // GenVerticesFromRawOBJ for the fields of a face line
+        //	(its tail), without allocating
+        void GenVerticesFromFaceView(std::vector<Vertex>& oVerts,
+                                     const std::vector<Vector3>& iPositions,
+                                     const std::vector<Vector2>& iTCoords,
+                                     const std::vector<Vector3>& iNormals,
+                                     std::string_view fields)
+        {
+            Vertex vVert;
+            bool noNormal = false;
+
+            for (std::string_view field = algorithm::nextField(fields); !field.empty(); field = algorithm::nextField(fields))
+            {
+                // Up to three parts: v, v/vt, v//vn or v/vt/vn
+                std::string_view parts[3];
+                int partCount = 0;
+                while (partCount < 3)
+                {
+                    size_t slash = field.find('/');
+                    parts[partCount++] = field.substr(0, slash);
+                    if (slash == std::string_view::npos)
+                        break;
+                    field.remove_prefix(slash + 1);
+                }
+
+                vVert.Position = algorithm::getElement(iPositions, parts[0]);
+                if (partCount >= 2 && !parts[1].empty())
+                    vVert.TextureCoordinate = algorithm::getElement(iTCoords, parts[1]);
+                else
+                    vVert.TextureCoordinate = Vector2(0, 0);
+                if (partCount == 3)
+                    vVert.Normal = algorithm::getElement(iNormals, parts[2]);
+                else
+                    noNormal = true;
+                oVerts.push_back(vVert);
+            }
+
+            // take care of missing normals, as GenVerticesFromRawOBJ does
+            if (noNormal && oVerts.size() >= 3)
+            {
+                Vector3 A = oVerts[0].Position - oVerts[1].Position;
+                Vector3 B = oVerts[2].Position - oVerts[1].Position;
+
+                Vector3 normal = math::CrossV3(A, B);
+
+                for (int i = 0; i < int(oVerts.size()); i++)
+                {
+                    oVerts[i].Normal = normal;
+                }
+            }
+        }
+
         // Generate vertices from a list of positions,
         //	tcoords, normals and a face line
         void GenVerticesFromRawOBJ(std::vector<Vertex>& oVerts,
@@ -4,10 +4,38 @@
 
 #ifndef RASTERIZER_SHADER_H
 #define RASTERIZER_SHADER_H
+#include <type_traits>
+#include <utility>
 #include <eigen3/Eigen/Eigen>
 #include "Texture.hpp"
 
 
+struct light
+{
+    Eigen::Vector3f position;
+    Eigen::Vector3f intensity;
+};
+
+// Per-draw constants of the lighting shaders, set with rasterizer::set_uniforms in world space. The
+// rasterizer hands shaders a copy with positions transformed to view space, where they shade, once
+// per draw. The defaults are the assignment's lights and eye, which it gives in view space for the
+// default camera at (0, 0, 10).
+constexpr int max_lights = 4;
+
+struct uniform_block
+{
+    light lights[max_lights] = {{{20, 20, 30}, {500, 500, 500}}, {{-20, 20, 10}, {500, 500, 500}}};
+    int light_count = 2;
+    Eigen::Vector3f ambient_intensity = Eigen::Vector3f(10, 10, 10);
+    Eigen::Vector3f eye_pos = Eigen::Vector3f(0, 0, 20);
+
+    // Material: ambient and specular coefficients and the specular exponent. The diffuse
+    // coefficient comes from the fragment (color or texture).
+    Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
+    Eigen::Vector3f ks = Eigen::Vector3f(0.7937, 0.7937, 0.7937);
+    float shininess = 150;
+};
+
 struct fragment_shader_payload
 {
     fragment_shader_payload()
@@ -15,7 +43,7 @@ struct fragment_shader_payload
         texture = nullptr;
     }
 
-    fragment_shader_payload(const Eigen::Vector3f& col, const Eigen::Vector3f& nor,const Eigen::Vector2f& tc, Texture* tex) :
+    fragment_shader_payload(const Eigen::Vector3f& col, const Eigen::Vector3f& nor,const Eigen::Vector2f& tc, const Texture* tex) :
          color(col), normal(nor), tex_coords(tc), texture(tex) {}
 
 
@@ -23,9 +51,45 @@ struct fragment_shader_payload
     Eigen::Vector3f color;
     Eigen::Vector3f normal;
     Eigen::Vector2f tex_coords;
-    Texture* texture;
+    // Change of tex_coords per pixel step in x and in y, for Texture::sample
+    Eigen::Vector2f tex_coords_dx = Eigen::Vector2f::Zero();
+    Eigen::Vector2f tex_coords_dy = Eigen::Vector2f::Zero();
+    const Texture* texture;
+    const uniform_block* uniforms = nullptr;
 };
 
+// Up to packet_width horizontally adjacent fragments of one span, in structure-of-arrays form:
+// normal[c][lane] is component c of the lane's interpolated normal (not normalized). Lanes not set
+// in mask hold unspecified values; shaders may compute them but their results are discarded.
+constexpr int packet_width = 8;
+
+struct fragment_packet
+{
+    unsigned mask;
+    const float (*color)[packet_width];
+    const float (*normal)[packet_width];
+    const float (*tex_coords)[packet_width];
+    const float (*tex_coords_dx)[packet_width];
+    const float (*tex_coords_dy)[packet_width];
+    const float (*view_pos)[packet_width];
+    const Texture* texture;
+    const uniform_block* uniforms;
+};
+
+struct color_packet
+{
+    float rgb[3][packet_width];
+};
+
+// Shaders callable as shader(const fragment_packet&, color_packet&) are given whole spans by the
+// rasterizer instead of one fragment_shader_payload per fragment.
+template<typename Shader, typename = void>
+struct is_packet_shader : std::false_type {};
+
+template<typename Shader>
+struct is_packet_shader<Shader, std::void_t<decltype(std::declval<const Shader&>()(std::declval<const fragment_packet&>(), std::declval<color_packet&>()))>>
+    : std::true_type {};
+
 struct vertex_shader_payload
 {
     Eigen::Vector3f position;
@@ -5,29 +5,179 @@
 #ifndef RASTERIZER_TEXTURE_H
 #define RASTERIZER_TEXTURE_H
 #include "global.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
 #include <eigen3/Eigen/Eigen>
 #include <opencv2/opencv.hpp>
 class Texture{
 private:
     cv::Mat image_data;
 
+    // Mip pyramid: levels[0] is image_data, every further level halves both sizes (area averaged)
+    // down to 1x1. Built once at load time.
+    std::vector<cv::Mat> levels;
+
+    // Swizzled copy of one level: RGBA8 texels in 4x4 blocks of 64 bytes (one cache line), Morton
+    // order inside a block and blocks row by row, so a bilinear footprint or a walk in any direction
+    // stays within few lines.
+    struct swizzled_level
+    {
+        int width, height, blocks_x;
+        std::vector<uint32_t> texels;
+    };
+    std::vector<swizzled_level> swizzled;
+
+    static int swizzle(const swizzled_level& level, int x, int y)
+    {
+        int morton = (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+        return ((y >> 2) * level.blocks_x + (x >> 2)) * 16 + morton;
+    }
+
+    Eigen::Vector3f texel(int level, int x, int y) const
+    {
+        if (!swizzled.empty())
+        {
+            const swizzled_level& s = swizzled[level];
+            uint32_t rgba = s.texels[swizzle(s, std::clamp(x, 0, s.width - 1), std::clamp(y, 0, s.height - 1))];
+            return Eigen::Vector3f(rgba & 0xff, (rgba >> 8) & 0xff, (rgba >> 16) & 0xff);
+        }
+        const cv::Mat& image = levels[level];
+        x = std::clamp(x, 0, image.cols - 1);
+        y = std::clamp(y, 0, image.rows - 1);
+        auto color = image.at<cv::Vec3b>(y, x);
+        return Eigen::Vector3f(color[0], color[1], color[2]);
+    }
+
 public:
+    // How sample() filters: Nearest is getColor, Bilinear filters level 0, Trilinear blends the
+    // two mip levels around the level of detail given by the UV derivatives.
+    enum class Filter
+    {
+        Nearest,
+        Bilinear,
+        Trilinear
+    };
+
     Texture(const std::string& name)
     {
         image_data = cv::imread(name);
         cv::cvtColor(image_data, image_data, cv::COLOR_RGB2BGR);
         width = image_data.cols;
         height = image_data.rows;
+
+        levels.push_back(image_data);
+        while (levels.back().cols > 1 || levels.back().rows > 1)
+        {
+            const cv::Mat& last = levels.back();
+            cv::Mat next;
+            cv::resize(last, next, cv::Size(std::max(1, last.cols / 2), std::max(1, last.rows / 2)), 0, 0, cv::INTER_AREA);
+            levels.push_back(next);
+        }
     }
 
     int width, height;
 
-    Eigen::Vector3f getColor(float u, float v)
+    Filter filter = Filter::Nearest;
+
+    // Texel storage the samplers read: the row-major 3-byte texels of the loaded cv::Mat, or the
+    // swizzled RGBA8 copy built by set_layout(Layout::Swizzled).
+    enum class Layout
+    {
+        Linear,
+        Swizzled
+    };
+
+    void set_layout(Layout layout)
+    {
+        swizzled.clear();
+        if (layout == Layout::Linear)
+        {
+            return;
+        }
+        for (const cv::Mat& image : levels)
+        {
+            swizzled_level s{image.cols, image.rows, (image.cols + 3) / 4, {}};
+            s.texels.resize(s.blocks_x * ((image.rows + 3) / 4) * 16);
+            for (int y = 0; y < image.rows; ++y)
+            {
+                for (int x = 0; x < image.cols; ++x)
+                {
+                    auto color = image.at<cv::Vec3b>(y, x);
+                    s.texels[swizzle(s, x, y)] = color[0] | (color[1] << 8) | (color[2] << 16) | (0xffu << 24);
+                }
+            }
+            swizzled.push_back(std::move(s));
+        }
+    }
+
+    Layout layout() const { return swizzled.empty() ? Layout::Linear : Layout::Swizzled; }
+
+    // Byte offset of a texel within its level in the active layout (for cache profiling).
+    size_t texel_offset(int level, int x, int y) const
+    {
+        if (!swizzled.empty())
+        {
+            return swizzle(swizzled[level], x, y) * sizeof(uint32_t);
+        }
+        return (size_t(y) * levels[level].cols + x) * 3;
+    }
+
+    int level_count() const { return levels.size(); }
+
+    Eigen::Vector3f getColor(float u, float v) const
     {
         auto u_img = u * width;
         auto v_img = (1 - v) * height;
-        auto color = image_data.at<cv::Vec3b>(v_img, u_img);
-        return Eigen::Vector3f(color[0], color[1], color[2]);
+        return texel(0, u_img, v_img);
+    }
+
+    // Bilinear filtering of one mip level, texel centers at half-integer coordinates, clamped to
+    // the edge.
+    Eigen::Vector3f getColorBilinear(float u, float v, int level = 0) const
+    {
+        level = std::clamp(level, 0, level_count() - 1);
+        float x = u * levels[level].cols - 0.5f;
+        float y = (1 - v) * levels[level].rows - 0.5f;
+        int x0 = std::floor(x), y0 = std::floor(y);
+        float fx = x - x0, fy = y - y0;
+        Eigen::Vector3f top = (1 - fx) * texel(level, x0, y0) + fx * texel(level, x0 + 1, y0);
+        Eigen::Vector3f bottom = (1 - fx) * texel(level, x0, y0 + 1) + fx * texel(level, x0 + 1, y0 + 1);
+        return (1 - fy) * top + fy * bottom;
+    }
+
+    // Level of detail from the screen-space derivatives of (u, v): log2 of the longer texel
+    // footprint of one pixel step, clamped to the pyramid.
+    float lod(const Eigen::Vector2f& duv_dx, const Eigen::Vector2f& duv_dy) const
+    {
+        Eigen::Vector2f size(width, height);
+        float rho = std::max(duv_dx.cwiseProduct(size).norm(), duv_dy.cwiseProduct(size).norm());
+        return std::clamp(std::log2(std::max(rho, 1.f)), 0.f, float(level_count() - 1));
+    }
+
+    Eigen::Vector3f getColorTrilinear(float u, float v, const Eigen::Vector2f& duv_dx, const Eigen::Vector2f& duv_dy) const
+    {
+        float level = lod(duv_dx, duv_dy);
+        int base = level;
+        float t = level - base;
+        Eigen::Vector3f color = getColorBilinear(u, v, base);
+        if (t > 0)
+        {
+            color = (1 - t) * color + t * getColorBilinear(u, v, base + 1);
+        }
+        return color;
+    }
+
+    // Samples with the texture's filter mode.
+    Eigen::Vector3f sample(float u, float v, const Eigen::Vector2f& duv_dx, const Eigen::Vector2f& duv_dy) const
+    {
+        switch (filter)
+        {
+            case Filter::Bilinear: return getColorBilinear(u, v);
+            case Filter::Trilinear: return getColorTrilinear(u, v, duv_dx, duv_dy);
+            default: return getColor(u, v);
+        }
     }
 
 };
@@ -0,0 +1,1724 @@
+//
+// Micro-benchmarks for the rasterizer building blocks. Run: ./RasterizerBench [name]
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <eigen3/Eigen/Eigen>
+
+#include "OBJ_Loader.h"
+#include "image_writer.hpp"
+#include "mesh_cache.hpp"
+#include "mesh_optimize.hpp"
+#include "mesh_simplify.hpp"
+#include "raster_simd.hpp"
+#include "rasterizer.hpp"
+#include "scene.hpp"
+#include "shaders.hpp"
+#include "transforms.hpp"
+#include "triangle_setup.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+// Heap allocations made by this process, for checking the per-fragment path does not allocate.
+static std::atomic<long> allocation_count{0};
+
+// The whole replaceable set is replaced, so every form allocates with malloc and frees with free.
+// The deletes stay out of line: inlined, GCC pairs their free() with the new-expression at the
+// call site and warns about a mismatch (-Wmismatched-new-delete).
+static void* counted_malloc(size_t size)
+{
+    allocation_count++;
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new(size_t size)
+{
+    if (void* p = counted_malloc(size))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size);
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+static double elapsed_ms(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static std::vector<std::array<Eigen::Vector4f, 3>> random_triangles(int count, float size, int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> pos(size, 700.f - size);
+    std::uniform_real_distribution<float> offset(-size, size);
+    std::vector<std::array<Eigen::Vector4f, 3>> triangles(count);
+    for (auto& t : triangles)
+    {
+        Eigen::Vector2f center(pos(rng), pos(rng));
+        for (auto& v : t)
+        {
+            v = Eigen::Vector4f(center.x() + offset(rng), center.y() + offset(rng), 0.5f, 1.f);
+        }
+    }
+    return triangles;
+}
+
+// An OBJ model as the triangle list draw() takes and as a Mesh with one vertex per corner, plus a
+// matrix that centers it and scales it to roughly the size of spot in the default view.
+struct bench_model
+{
+    std::string name;
+    std::vector<Triangle> storage;
+    std::vector<Triangle*> triangles;
+    rst::Mesh mesh;
+    Eigen::Matrix4f normalize;
+};
+
+static bench_model load_model(const std::string& name, const std::string& path)
+{
+    bench_model model;
+    model.name = name;
+
+    objl::Loader loader;
+    loader.LoadFile(path);
+    Eigen::Vector3f lo = Eigen::Vector3f::Constant(std::numeric_limits<float>::max());
+    Eigen::Vector3f hi = -lo;
+    for (auto& mesh : loader.LoadedMeshes)
+    {
+        for (size_t i = 0; i + 2 < mesh.Vertices.size(); i += 3)
+        {
+            Triangle t;
+            for (int j = 0; j < 3; ++j)
+            {
+                const auto& vertex = mesh.Vertices[i + j];
+                Eigen::Vector3f p(vertex.Position.X, vertex.Position.Y, vertex.Position.Z);
+                lo = lo.cwiseMin(p);
+                hi = hi.cwiseMax(p);
+                t.setVertex(j, Eigen::Vector4f(p.x(), p.y(), p.z(), 1.f));
+                t.setNormal(j, Eigen::Vector3f(vertex.Normal.X, vertex.Normal.Y, vertex.Normal.Z));
+                t.setTexCoord(j, Eigen::Vector2f(vertex.TextureCoordinate.X, vertex.TextureCoordinate.Y));
+                t.setColor(j, 148, 121, 92);
+
+                model.mesh.indices.push_back(model.mesh.positions.size());
+                model.mesh.positions.push_back(p);
+                model.mesh.normals.push_back(t.normal[j]);
+                model.mesh.tex_coords.push_back(t.tex_coords[j]);
+                model.mesh.colors.push_back(t.color[j]);
+            }
+            model.storage.push_back(t);
+        }
+    }
+    for (auto& t : model.storage)
+    {
+        model.triangles.push_back(&t);
+    }
+
+    // get_model_matrix() scales by 2.5, which fits spot (radius ~0.9) into the view.
+    float radius = std::max(1e-6f, 0.5f * (hi - lo).norm());
+    Eigen::Vector3f center = 0.5f * (lo + hi);
+    model.normalize = Eigen::Matrix4f::Identity();
+    model.normalize.topLeftCorner<3, 3>() *= 0.9f / radius;
+    model.normalize.topRightCorner<3, 1>() = -center * (0.9f / radius);
+    return model;
+}
+
+static Eigen::Vector3f bench_normal_shader(const fragment_shader_payload& payload)
+{
+    return (payload.normal + Eigen::Vector3f(1.0f, 1.0f, 1.0f)) * 127.5f;
+}
+
+static void setup_view(rst::rasterizer& r, const bench_model& model, float angle)
+{
+    r.set_model(get_model_matrix(angle) * model.normalize);
+    r.set_view(get_view_matrix({0, 0, 10}));
+    r.set_projection(get_projection_matrix(45.0, 1, 0.1, 50));
+}
+
+// insideTriangle + computeBarycentric2D per pixel vs. edge setup once per triangle and
+// incremental edge stepping inside the loops.
+static bool bench_edge_function()
+{
+    bool ok = true;
+    printf("%-12s %8s %12s %12s %10s %10s %8s\n", "size(px)", "tris", "legacy(ms)", "edge(ms)", "speedup", "covered", "on edge");
+    for (float size : {4.f, 16.f, 64.f, 256.f})
+    {
+        int count = (int)(4e6 / (size * size)) + 1;
+        auto triangles = random_triangles(count, size, 7);
+        // Degenerate triangles cover nothing: setup_triangle rejects them, and computeBarycentric2D
+        // divides by zero (its float area can round to 0 even when the snapped one does not)
+        triangles.erase(std::remove_if(triangles.begin(), triangles.end(), [](const auto& t) {
+                            rst::triangle_setup setup;
+                            auto [alpha, beta, gamma] = rst::computeBarycentric2D(t[0].x(), t[0].y(), t.data());
+                            return !std::isfinite(alpha + beta + gamma) || !rst::setup_triangle(t.data(), setup);
+                        }),
+                        triangles.end());
+
+        double legacy_sum = 0;
+        long legacy_covered = 0;
+        auto start = Clock::now();
+        for (auto& t : triangles)
+        {
+            int x0 = std::floor(std::min({t[0].x(), t[1].x(), t[2].x()}));
+            int x1 = std::ceil(std::max({t[0].x(), t[1].x(), t[2].x()}));
+            int y0 = std::floor(std::min({t[0].y(), t[1].y(), t[2].y()}));
+            int y1 = std::ceil(std::max({t[0].y(), t[1].y(), t[2].y()}));
+            for (int y = y0; y < y1; ++y)
+            {
+                for (int x = x0; x < x1; ++x)
+                {
+                    if (rst::insideTriangle(x, y, t.data()))
+                    {
+                        auto [alpha, beta, gamma] = rst::computeBarycentric2D(x, y, t.data());
+                        legacy_sum += alpha * t[0].z() + beta * t[1].z() + gamma * t[2].z();
+                        ++legacy_covered;
+                    }
+                }
+            }
+        }
+        double legacy_ms = elapsed_ms(start);
+
+        double edge_sum = 0;
+        long edge_covered = 0;
+        start = Clock::now();
+        for (auto& t : triangles)
+        {
+            rst::triangle_setup setup;
+            rst::setup_triangle(t.data(), setup);
+            int x0 = std::floor(std::min({t[0].x(), t[1].x(), t[2].x()}));
+            int x1 = std::ceil(std::max({t[0].x(), t[1].x(), t[2].x()}));
+            int y0 = std::floor(std::min({t[0].y(), t[1].y(), t[2].y()}));
+            int y1 = std::ceil(std::max({t[0].y(), t[1].y(), t[2].y()}));
+            for (int y = y0; y < y1; ++y)
+            {
+                double e[3] = {setup.edge(0, x0, y), setup.edge(1, x0, y), setup.edge(2, x0, y)};
+                for (int x = x0; x < x1; ++x, e[0] += setup.a[0], e[1] += setup.a[1], e[2] += setup.a[2])
+                {
+                    if (e[0] > 0 && e[1] > 0 && e[2] > 0)
+                    {
+                        auto [alpha, beta, gamma] = setup.barycentric(e);
+                        edge_sum += alpha * t[0].z() + beta * t[1].z() + gamma * t[2].z();
+                        ++edge_covered;
+                    }
+                }
+            }
+        }
+        double edge_ms = elapsed_ms(start);
+
+        // Pixels within 1/128 px of an edge, where snapping the vertices to 1/256 px and the float
+        // math of the legacy test may disagree
+        long on_edge = 0;
+        for (auto& t : triangles)
+        {
+            rst::triangle_setup setup;
+            rst::setup_triangle(t.data(), setup);
+            int x0 = std::floor(std::min({t[0].x(), t[1].x(), t[2].x()}));
+            int x1 = std::ceil(std::max({t[0].x(), t[1].x(), t[2].x()}));
+            int y0 = std::floor(std::min({t[0].y(), t[1].y(), t[2].y()}));
+            int y1 = std::ceil(std::max({t[0].y(), t[1].y(), t[2].y()}));
+            for (int y = y0; y < y1; ++y)
+            {
+                for (int x = x0; x < x1; ++x)
+                {
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        if (std::abs(setup.edge(i, x, y)) <= std::hypot(setup.a[i], setup.b[i]) / 128)
+                        {
+                            ++on_edge;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        printf("%-12.0f %8zu %12.2f %12.2f %9.2fx %10ld %8ld\n", size, triangles.size(), legacy_ms, edge_ms,
+               legacy_ms / edge_ms, edge_covered, on_edge);
+        // Every vertex has depth 0.5, so each on-edge pixel moves the sums by 0.5 at most
+        long coverage_error = std::abs(edge_covered - legacy_covered);
+        double sum_error = std::abs(edge_sum - legacy_sum);
+        if (coverage_error > on_edge || !(sum_error <= 0.5 * on_edge + 1e-5 * std::abs(legacy_sum)))
+        {
+            printf("%-12s MISMATCH: coverage differs by %ld px, sums %.1f vs %.1f\n", "", edge_covered - legacy_covered,
+                   edge_sum, legacy_sum);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Runs every span kernel the CPU supports over random triangles and a random depth buffer, checks
+// that masks, depth and attributes are bit-identical to the scalar kernel, and times each one.
+static bool bench_simd_kernels()
+{
+    const int size = 700;
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> depth_value(0.f, 1.f);
+    std::vector<float> depth(size * size);
+    for (auto& d : depth)
+    {
+        d = depth_value(rng);
+    }
+
+    auto triangles = random_triangles(20000, 24.f, 3);
+    std::vector<rst::triangle_attributes> attributes(triangles.size());
+    for (auto& a : attributes)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            a.z[i] = depth_value(rng);
+            for (auto& attr : a.attr)
+            {
+                attr[i] = depth_value(rng);
+            }
+        }
+    }
+
+    // Runs kernel over every span of every triangle; records mask, depth and attributes per span.
+    auto run = [&](rst::span_kernel kernel, std::vector<unsigned>* masks, std::vector<float>* values) {
+        rst::fragment_lanes lanes;
+        long fragments = 0;
+        for (size_t t = 0; t < triangles.size(); ++t)
+        {
+            rst::triangle_setup setup;
+            if (!rst::setup_triangle(triangles[t].data(), setup))
+            {
+                continue;
+            }
+            auto& v = triangles[t];
+            int x0 = std::max(0, (int)std::floor(std::min({v[0].x(), v[1].x(), v[2].x()})));
+            int x1 = std::min(size, (int)std::ceil(std::max({v[0].x(), v[1].x(), v[2].x()})));
+            int y0 = std::max(0, (int)std::floor(std::min({v[0].y(), v[1].y(), v[2].y()})));
+            int y1 = std::min(size, (int)std::ceil(std::max({v[0].y(), v[1].y(), v[2].y()})));
+            for (int y = y0; y < y1; ++y)
+            {
+                for (int x = x0; x < x1; x += rst::span_width)
+                {
+                    int count = std::min(rst::span_width, x1 - x);
+                    unsigned mask = kernel(setup, attributes[t], x, y, count, &depth[y * size + x], lanes);
+                    fragments += __builtin_popcount(mask);
+                    if (!masks)
+                    {
+                        continue;
+                    }
+                    masks->push_back(mask);
+                    for (int lane = 0; lane < rst::span_width; ++lane)
+                    {
+                        if (mask & (1u << lane))
+                        {
+                            values->push_back(lanes.z[lane]);
+                            for (auto& attr : lanes.attr)
+                            {
+                                values->push_back(attr[lane]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return fragments;
+    };
+
+    std::vector<unsigned> reference_masks;
+    std::vector<float> reference_values;
+    run(rst::get_span_kernel(rst::simd_level::Scalar), &reference_masks, &reference_values);
+
+    bool ok = true;
+    auto best = rst::detect_simd_level();
+    printf("%-8s %10s %12s %10s\n", "kernel", "time(ms)", "fragments", "parity");
+    for (auto level : {rst::simd_level::Scalar, rst::simd_level::SSE2, rst::simd_level::AVX2})
+    {
+        if ((int)level > (int)best)
+        {
+            printf("%-8s %10s\n", rst::to_string(level), "n/a");
+            continue;
+        }
+        auto kernel = rst::get_span_kernel(level);
+
+        std::vector<unsigned> masks;
+        std::vector<float> values;
+        run(kernel, &masks, &values);
+        bool same = masks == reference_masks && values.size() == reference_values.size() &&
+                    std::memcmp(values.data(), reference_values.data(), values.size() * sizeof(float)) == 0;
+        ok = ok && same;
+
+        auto start = Clock::now();
+        long fragments = run(kernel, nullptr, nullptr);
+        printf("%-8s %10.2f %12ld %10s\n", rst::to_string(level), elapsed_ms(start), fragments, same ? "exact" : "MISMATCH");
+    }
+    return ok;
+}
+
+// Fragment shader invocations and frame time of forward vs. deferred shading. Triangles are drawn
+// in file order, so forward shading pays for every occluded fragment that wins the depth test first.
+static void bench_overdraw()
+{
+    printf("%-6s %6s %-9s %12s %10s %10s\n", "model", "angle", "mode", "shaded", "pixels", "time(ms)");
+    for (auto [name, path] : {std::pair{"spot", "../models/spot/spot_triangulated_good.obj"},
+                              std::pair{"bunny", "../models/bunny/bunny.obj"},
+                              std::pair{"rock", "../models/rock/rock.obj"}})
+    {
+        auto model = load_model(name, path);
+        for (float angle : {0.f, 140.f, 270.f})
+        {
+            for (auto mode : {rst::Shading::Forward, rst::Shading::Deferred})
+            {
+                rst::rasterizer r(700, 700);
+                r.set_fragment_shader(bench_normal_shader);
+                r.set_shading(mode);
+                setup_view(r, model, angle);
+
+                auto start = Clock::now();
+                r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+                r.draw(model.triangles);
+                double ms = elapsed_ms(start);
+
+                long pixels = std::count_if(r.frame_buffer().begin(), r.frame_buffer().end(),
+                                            [](const Eigen::Vector3f& c) { return c != Eigen::Vector3f::Zero(); });
+                printf("%-6s %6.0f %-9s %12ld %10ld %10.2f\n", name, angle,
+                       mode == rst::Shading::Forward ? "forward" : "deferred", r.stats().fragments_shaded, pixels, ms);
+            }
+        }
+    }
+}
+
+// Welds the corners of a triangle list that share position, normal and texture coordinates into
+// the indexed buffers of draw(pos_buf_id, ind_buf_id, ...).
+struct indexed_model
+{
+    std::vector<Eigen::Vector3f> positions;
+    std::vector<Eigen::Vector3f> normals;
+    std::vector<Eigen::Vector2f> tex_coords;
+    std::vector<Eigen::Vector3f> colors;
+    std::vector<Eigen::Vector3i> indices;
+};
+
+static indexed_model weld(const bench_model& model)
+{
+    indexed_model out;
+    std::map<std::array<float, 8>, int> lookup;
+    for (const Triangle* t : model.triangles)
+    {
+        Eigen::Vector3i triangle;
+        for (int j = 0; j < 3; ++j)
+        {
+            std::array<float, 8> key = {t->v[j].x(), t->v[j].y(), t->v[j].z(), t->normal[j].x(),
+                                        t->normal[j].y(), t->normal[j].z(), t->tex_coords[j].x(), t->tex_coords[j].y()};
+            auto [it, inserted] = lookup.emplace(key, (int)out.positions.size());
+            if (inserted)
+            {
+                out.positions.push_back(t->v[j].head<3>());
+                out.normals.push_back(t->normal[j]);
+                out.tex_coords.push_back(t->tex_coords[j]);
+                out.colors.push_back(Eigen::Vector3f(148, 121, 92));
+            }
+            triangle[j] = it->second;
+        }
+        out.indices.push_back(triangle);
+    }
+    return out;
+}
+
+// Geometry time of one draw with nothing rasterized (empty scissor): the triangle list path, which
+// transforms every corner, and the indexed path, which transforms each welded vertex once. Also
+// checks both paths render the same image.
+static bool bench_vertex_stage()
+{
+    const int runs = 50;
+    bool ok = true;
+    printf("%-6s %8s %10s %10s %10s %12s %8s\n", "model", "tris", "corners", "vertices", "list(ms)", "indexed(ms)", "image");
+    for (auto [name, path] : {std::pair{"spot", "../models/spot/spot_triangulated_good.obj"},
+                              std::pair{"bunny", "../models/bunny/bunny.obj"}})
+    {
+        auto model = load_model(name, path);
+        auto indexed = weld(model);
+
+        rst::rasterizer r(700, 700);
+        r.set_fragment_shader(bench_normal_shader);
+        setup_view(r, model, 140.f);
+        auto pos_id = r.load_positions(indexed.positions);
+        auto ind_id = r.load_indices(indexed.indices);
+        auto col_id = r.load_colors(indexed.colors);
+        r.load_normals(indexed.normals);
+        r.load_texcoords(indexed.tex_coords);
+
+        r.set_scissor({0, 0, 0, 0});
+        auto start = Clock::now();
+        for (int run = 0; run < runs; ++run)
+        {
+            r.draw(model.triangles);
+        }
+        double list_ms = elapsed_ms(start) / runs;
+
+        start = Clock::now();
+        for (int run = 0; run < runs; ++run)
+        {
+            r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
+        }
+        double indexed_ms = elapsed_ms(start) / runs;
+
+        r.set_scissor({0, 0, 700, 700});
+        r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+        r.draw(model.triangles);
+        auto list_image = r.frame_buffer();
+        r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+        r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
+        bool match = list_image == r.frame_buffer();
+        ok = ok && match;
+
+        printf("%-6s %8zu %10zu %10zu %10.3f %12.3f %8s\n", name, model.triangles.size(), model.triangles.size() * 3,
+               indexed.positions.size(), list_ms, indexed_ms, match ? "match" : "DIFFER");
+    }
+    return ok;
+}
+
+// Memory and traversal time of the old main.cpp layout (a heap-allocated Triangle per face, drawn
+// through std::vector<Triangle*>) against Mesh, per corner and with shared vertices welded.
+// "walk" reads every corner's position, normal and texture coordinates; "draw" is the geometry
+// time of one draw with an empty scissor.
+static bool bench_mesh_layout()
+{
+    const int runs = 50;
+    bool ok = true;
+    printf("%-6s %-12s %10s %10s %10s %8s\n", "model", "layout", "bytes", "walk(ms)", "draw(ms)", "image");
+    for (auto [name, path] : {std::pair{"spot", "../models/spot/spot_triangulated_good.obj"},
+                              std::pair{"bunny", "../models/bunny/bunny.obj"},
+                              std::pair{"rock", "../models/rock/rock.obj"}})
+    {
+        auto model = load_model(name, path);
+
+        std::vector<std::unique_ptr<Triangle>> heap;
+        std::vector<Triangle*> list;
+        for (const auto& t : model.storage)
+        {
+            heap.push_back(std::make_unique<Triangle>(t));
+            list.push_back(heap.back().get());
+        }
+
+        auto welded = weld(model);
+        rst::Mesh welded_mesh;
+        welded_mesh.positions = welded.positions;
+        welded_mesh.normals = welded.normals;
+        welded_mesh.tex_coords = welded.tex_coords;
+        for (const auto& c : welded.colors)
+        {
+            welded_mesh.colors.push_back(c / 255.f);
+        }
+        for (const auto& i : welded.indices)
+        {
+            welded_mesh.indices.insert(welded_mesh.indices.end(), {(uint32_t)i[0], (uint32_t)i[1], (uint32_t)i[2]});
+        }
+
+        rst::rasterizer r(700, 700);
+        r.set_fragment_shader(bench_normal_shader);
+        setup_view(r, model, 140.f);
+        r.set_scissor({0, 0, 0, 0});
+
+        double sum = 0;
+        auto start = Clock::now();
+        for (int run = 0; run < runs; ++run)
+        {
+            for (const Triangle* t : list)
+            {
+                for (int j = 0; j < 3; ++j)
+                {
+                    sum += t->v[j].x() + t->normal[j].y() + t->tex_coords[j].x();
+                }
+            }
+        }
+        double list_walk = elapsed_ms(start) / runs;
+        start = Clock::now();
+        for (int run = 0; run < runs; ++run)
+        {
+            r.draw(list);
+        }
+        double list_draw = elapsed_ms(start) / runs;
+        printf("%-6s %-12s %10zu %10.3f %10.3f %8s\n", name, "Triangle*", list.size() * (sizeof(Triangle) + sizeof(Triangle*)),
+               list_walk, list_draw, "-");
+
+        r.set_scissor({0, 0, 700, 700});
+        r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+        r.draw(list);
+        auto list_image = r.frame_buffer();
+
+        for (auto [layout, mesh] : {std::pair{"mesh", &model.mesh}, std::pair{"mesh welded", &welded_mesh}})
+        {
+            r.set_scissor({0, 0, 0, 0});
+            double mesh_sum = 0;
+            start = Clock::now();
+            for (int run = 0; run < runs; ++run)
+            {
+                for (uint32_t i : mesh->indices)
+                {
+                    mesh_sum += mesh->positions[i].x() + mesh->normals[i].y() + mesh->tex_coords[i].x();
+                }
+            }
+            double mesh_walk = elapsed_ms(start) / runs;
+            start = Clock::now();
+            for (int run = 0; run < runs; ++run)
+            {
+                r.draw(*mesh);
+            }
+            double mesh_draw = elapsed_ms(start) / runs;
+
+            r.set_scissor({0, 0, 700, 700});
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+            r.draw(*mesh);
+            bool match = list_image == r.frame_buffer() && mesh_sum == sum;
+            ok = ok && match;
+            printf("%-6s %-12s %10zu %10.3f %10.3f %8s\n", name, layout, mesh->memory_bytes(), mesh_walk, mesh_draw,
+                   match ? "match" : "DIFFER");
+        }
+    }
+    return ok;
+}
+
+// Frame time of spot with the fragment shader called through set_fragment_shader's std::function
+// against the same shader inlined by draw(mesh, shader). Both must render the same image.
+template<typename Shader>
+static bool bench_shader_dispatch(const char* name, const bench_model& model, std::function<Eigen::Vector3f(fragment_shader_payload)> function)
+{
+    const int runs = 10;
+    rst::rasterizer r(700, 700);
+    r.set_texture(Texture("../models/spot/spot_texture.png"));
+    r.set_fragment_shader(function);
+    setup_view(r, model, 140.f);
+
+    auto start = Clock::now();
+    for (int run = 0; run < runs; ++run)
+    {
+        r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+        r.draw(model.mesh);
+    }
+    double function_ms = elapsed_ms(start) / runs;
+    auto function_image = r.frame_buffer();
+
+    start = Clock::now();
+    for (int run = 0; run < runs; ++run)
+    {
+        r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+        r.draw(model.mesh, Shader{});
+    }
+    double template_ms = elapsed_ms(start) / runs;
+
+    bool match = function_image == r.frame_buffer();
+    printf("%-8s %12ld %14.2f %14.2f %9.2fx %8s\n", name, r.stats().fragments_shaded, function_ms, template_ms,
+           function_ms / template_ms, match ? "match" : "DIFFER");
+    return match;
+}
+
+static bool bench_shaders()
+{
+    auto model = load_model("spot", "../models/spot/spot_triangulated_good.obj");
+    printf("%-8s %12s %14s %14s %10s %8s\n", "shader", "fragments", "function(ms)", "template(ms)", "speedup", "image");
+    bool ok = bench_shader_dispatch<normal_shader>("normal", model, normal_fragment_shader);
+    ok = bench_shader_dispatch<phong_shader>("phong", model, phong_fragment_shader) && ok;
+    ok = bench_shader_dispatch<texture_shader>("texture", model, texture_fragment_shader) && ok;
+    ok = bench_shader_dispatch<bump_shader>("bump", model, bump_fragment_shader) && ok;
+    return ok;
+}
+
+// Per-fragment shaders against their packet ports, forward and deferred. The ports reorder the
+// float math, so images are compared with a tolerance of one 8-bit level.
+template<typename Shader, typename PacketShader>
+static bool bench_packet_shader(const char* name, const bench_model& model)
+{
+    const int runs = 10;
+    bool ok = true;
+    for (auto mode : {rst::Shading::Forward, rst::Shading::Deferred})
+    {
+        rst::rasterizer r(700, 700);
+        r.set_texture(Texture("../models/spot/spot_texture.png"));
+        r.set_shading(mode);
+        setup_view(r, model, 140.f);
+
+        auto start = Clock::now();
+        for (int run = 0; run < runs; ++run)
+        {
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+            r.draw(model.mesh, Shader{});
+        }
+        double fragment_ms = elapsed_ms(start) / runs;
+        auto fragment_image = r.frame_buffer();
+
+        start = Clock::now();
+        for (int run = 0; run < runs; ++run)
+        {
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+            r.draw(model.mesh, PacketShader{});
+        }
+        double packet_ms = elapsed_ms(start) / runs;
+
+        float max_diff = 0;
+        for (size_t i = 0; i < fragment_image.size(); ++i)
+        {
+            max_diff = std::max(max_diff, (fragment_image[i] - r.frame_buffer()[i]).cwiseAbs().maxCoeff());
+        }
+        ok = ok && max_diff < 1.f;
+        printf("%-8s %-9s %12ld %14.2f %12.2f %9.2fx %10.4f\n", name, mode == rst::Shading::Forward ? "forward" : "deferred",
+               r.stats().fragments_shaded, fragment_ms, packet_ms, fragment_ms / packet_ms, max_diff);
+    }
+    return ok;
+}
+
+static bool bench_packets()
+{
+    auto model = load_model("spot", "../models/spot/spot_triangulated_good.obj");
+    printf("%-8s %-9s %12s %14s %12s %10s %10s\n", "shader", "mode", "fragments", "fragment(ms)", "packet(ms)", "speedup", "max diff");
+    bool ok = bench_packet_shader<phong_shader, phong_packet_shader>("phong", model);
+    ok = bench_packet_shader<texture_shader, texture_packet_shader>("texture", model) && ok;
+    return ok;
+}
+
+// Heap allocations during one frame of spot after a warm-up frame, per shader. Shaders read the
+// uniform block instead of building their light list per fragment, so the count must not grow with
+// the fragments shaded.
+template<typename Shader>
+static bool count_frame_allocations(const char* name, const bench_model& model, const Shader& shader)
+{
+    rst::rasterizer r(700, 700);
+    r.set_texture(Texture("../models/spot/spot_texture.png"));
+    r.set_fragment_shader(phong_fragment_shader);
+    setup_view(r, model, 140.f);
+
+    r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+    r.draw(model.mesh, shader);
+    r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+    long before = allocation_count;
+    auto start = Clock::now();
+    r.draw(model.mesh, shader);
+    double ms = elapsed_ms(start);
+    long allocations = allocation_count - before;
+
+    bool ok = allocations * 100 < r.stats().fragments_shaded;
+    printf("%-16s %12ld %12ld %10.2f\n", name, r.stats().fragments_shaded, allocations, ms);
+    return ok;
+}
+
+static bool bench_uniforms()
+{
+    auto model = load_model("spot", "../models/spot/spot_triangulated_good.obj");
+    printf("%-16s %12s %12s %10s\n", "shader", "fragments", "allocations", "time(ms)");
+    bool ok = count_frame_allocations("phong", model, phong_shader{});
+    ok = count_frame_allocations("texture", model, texture_shader{}) && ok;
+    ok = count_frame_allocations("bump", model, bump_shader{}) && ok;
+    ok = count_frame_allocations("displacement", model, displacement_shader{}) && ok;
+    ok = count_frame_allocations("phong packet", model, phong_packet_shader{}) && ok;
+    ok = count_frame_allocations("texture packet", model, texture_packet_shader{}) && ok;
+    return ok;
+}
+
+// Texture-bound throughput of the texture shader on spot with the camera at several distances,
+// for each filter mode. Far away the texture is minified, which is where mip levels matter.
+static void bench_texture_filtering()
+{
+    const int runs = 10;
+    auto model = load_model("spot", "../models/spot/spot_triangulated_good.obj");
+    Texture texture("../models/spot/spot_texture.png");
+    printf("mip levels: %d\n", texture.level_count());
+    printf("%-9s %-10s %12s %10s %14s\n", "distance", "filter", "fragments", "time(ms)", "Mfragments/s");
+    for (float distance : {4.f, 10.f, 20.f, 40.f})
+    {
+        for (auto [name, filter] : {std::pair{"nearest", Texture::Filter::Nearest},
+                                    std::pair{"bilinear", Texture::Filter::Bilinear},
+                                    std::pair{"trilinear", Texture::Filter::Trilinear}})
+        {
+            texture.filter = filter;
+            rst::rasterizer r(700, 700);
+            r.set_texture(texture);
+            setup_view(r, model, 140.f);
+            r.set_view(get_view_matrix({0, 0, distance}));
+
+            auto start = Clock::now();
+            for (int run = 0; run < runs; ++run)
+            {
+                r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+                r.draw(model.mesh, texture_shader{});
+            }
+            double ms = elapsed_ms(start) / runs;
+            long fragments = r.stats().fragments_shaded;
+            printf("%-9.0f %-10s %12ld %10.2f %14.2f\n", distance, name, fragments, ms, fragments / ms / 1e3);
+        }
+    }
+}
+
+// Fully associative LRU cache of 64-byte lines, to count the misses of a texel access pattern.
+struct line_cache
+{
+    std::vector<std::pair<size_t, long>> lines;  // line, last use
+    long clock = 0;
+    long misses = 0;
+
+    explicit line_cache(int count) : lines(count, {size_t(-1), -1}) {}
+
+    void access(size_t address)
+    {
+        size_t line = address / 64;
+        auto oldest = lines.begin();
+        for (auto it = lines.begin(); it != lines.end(); ++it)
+        {
+            if (it->first == line)
+            {
+                it->second = ++clock;
+                return;
+            }
+            if (it->second < oldest->second)
+            {
+                oldest = it;
+            }
+        }
+        *oldest = {line, ++clock};
+        misses++;
+    }
+};
+
+// Row-major 3-byte texels against 4x4 swizzled RGBA8 blocks. First bilinear walks across level 0
+// in three directions, with the misses of a 4 KB line cache per sample; then texture and bump
+// shader frame times on spot, which must render the same image with either layout.
+static bool bench_texture_layout()
+{
+    Texture texture("../models/spot/spot_texture.png");
+    const int samples = 200000;
+    printf("%-10s %-9s %14s %10s\n", "walk", "layout", "misses/sample", "time(ms)");
+    for (auto [name, dx, dy] : {std::tuple{"row", 1.f, 0.f}, std::tuple{"column", 0.f, 1.f}, std::tuple{"diagonal", 0.7f, 0.7f}})
+    {
+        for (auto layout : {Texture::Layout::Linear, Texture::Layout::Swizzled})
+        {
+            texture.set_layout(layout);
+            line_cache cache(64);
+            float x = 0.5f, y = 0.5f;
+            for (int i = 0; i < samples; ++i, x += dx, y += dy)
+            {
+                int tx = int(x) % (texture.width - 1), ty = int(y) % (texture.height - 1);
+                for (int k = 0; k < 4; ++k)
+                {
+                    cache.access(texture.texel_offset(0, tx + (k & 1), ty + (k >> 1)));
+                }
+            }
+
+            Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+            auto start = Clock::now();
+            x = 0.5f, y = 0.5f;
+            for (int i = 0; i < samples; ++i, x += dx, y += dy)
+            {
+                sum += texture.getColorBilinear(std::fmod(x, texture.width) / texture.width, 1 - std::fmod(y, texture.height) / texture.height);
+            }
+            double ms = elapsed_ms(start);
+            printf("%-10s %-9s %14.3f %10.2f\n", name, layout == Texture::Layout::Linear ? "linear" : "swizzled",
+                   double(cache.misses) / samples, ms + sum.x() * 0);
+        }
+    }
+
+    const int runs = 10;
+    bool ok = true;
+    auto model = load_model("spot", "../models/spot/spot_triangulated_good.obj");
+    printf("%-8s %14s %14s %8s\n", "shader", "linear(ms)", "swizzled(ms)", "image");
+    for (auto [name, texture_file] : {std::pair{"texture", "spot_texture.png"}, std::pair{"bump", "hmap.jpg"}})
+    {
+        double ms[2];
+        std::vector<Eigen::Vector3f> images[2];
+        for (int i = 0; i < 2; ++i)
+        {
+            Texture t(std::string("../models/spot/") + texture_file);
+            t.filter = Texture::Filter::Bilinear;
+            t.set_layout(i == 0 ? Texture::Layout::Linear : Texture::Layout::Swizzled);
+            rst::rasterizer r(700, 700);
+            r.set_texture(t);
+            setup_view(r, model, 140.f);
+
+            auto start = Clock::now();
+            for (int run = 0; run < runs; ++run)
+            {
+                r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+                if (std::string(name) == "texture")
+                {
+                    r.draw(model.mesh, texture_shader{});
+                }
+                else
+                {
+                    r.draw(model.mesh, bump_shader{});
+                }
+            }
+            ms[i] = elapsed_ms(start) / runs;
+            images[i] = r.frame_buffer();
+        }
+        bool match = images[0] == images[1];
+        ok = ok && match;
+        printf("%-8s %14.2f %14.2f %8s\n", name, ms[0], ms[1], match ? "match" : "DIFFER");
+    }
+    return ok;
+}
+
+// Frame handoff to OpenCV: RGBFloat followed by convertTo + cvtColor (what main.cpp did) against
+// BGRA8 written directly by the rasterizer, at 700x700 and 4K. The bytes must agree, and the
+// PlanarFloat planes must hold the same floats as RGBFloat.
+static bool bench_framebuffer()
+{
+    const int runs = 10;
+    bool ok = true;
+    auto model = load_model("spot", "../models/spot/spot_triangulated_good.obj");
+    printf("%-10s %-10s %10s %12s %10s %8s\n", "size", "format", "draw(ms)", "handoff(ms)", "total(ms)", "image");
+    for (auto [w, h] : {std::pair{700, 700}, std::pair{3840, 2160}})
+    {
+        rst::rasterizer r(w, h);
+        setup_view(r, model, 140.f);
+
+        double draw_ms = 0, handoff_ms = 0;
+        cv::Mat reference;
+        for (int run = 0; run < runs; ++run)
+        {
+            auto start = Clock::now();
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+            r.draw(model.mesh, phong_shader{});
+            draw_ms += elapsed_ms(start);
+            start = Clock::now();
+            cv::Mat image(h, w, CV_32FC3, r.frame_buffer().data());
+            image.convertTo(image, CV_8UC3, 1.0f);
+            cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+            handoff_ms += elapsed_ms(start);
+            reference = image;
+        }
+        std::string size = std::to_string(w) + "x" + std::to_string(h);
+        printf("%-10s %-10s %10.2f %12.2f %10.2f %8s\n", size.c_str(), "RGBFloat", draw_ms / runs, handoff_ms / runs,
+               (draw_ms + handoff_ms) / runs, "-");
+        std::vector<Eigen::Vector3f> float_image = r.frame_buffer();
+
+        r.set_format(rst::Format::BGRA8);
+        draw_ms = handoff_ms = 0;
+        cv::Mat bgra;
+        for (int run = 0; run < runs; ++run)
+        {
+            auto start = Clock::now();
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+            r.draw(model.mesh, phong_shader{});
+            draw_ms += elapsed_ms(start);
+            start = Clock::now();
+            bgra = r.frame_image();
+            handoff_ms += elapsed_ms(start);
+        }
+        bool match = true;
+        for (int y = 0; y < h && match; ++y)
+        {
+            for (int x = 0; x < w && match; ++x)
+            {
+                const auto& a = reference.at<cv::Vec3b>(y, x);
+                const auto& b = bgra.at<cv::Vec4b>(y, x);
+                match = a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && b[3] == 255;
+            }
+        }
+        ok = ok && match;
+        printf("%-10s %-10s %10.2f %12.2f %10.2f %8s\n", size.c_str(), "BGRA8", draw_ms / runs, handoff_ms / runs,
+               (draw_ms + handoff_ms) / runs, match ? "match" : "DIFFER");
+
+        r.set_format(rst::Format::PlanarFloat);
+        r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+        r.draw(model.mesh, phong_shader{});
+        cv::Mat planes = r.frame_image();
+        match = true;
+        for (int i = 0; i < w * h && match; ++i)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                match = match && planes.ptr<float>(c * h)[i] == float_image[i][c];
+            }
+        }
+        ok = ok && match;
+        printf("%-10s %-10s %10s %12s %10s %8s\n", size.c_str(), "Planar", "", "", "", match ? "match" : "DIFFER");
+    }
+    return ok;
+}
+
+// Fast clear: clear() against the full-buffer fills it used to do (color and depth), at 700x700 and
+// 4K, and a whole frame (clear, draw, read back). A frame drawn over a previous one with a non-black
+// clear color must match the same frame drawn by a fresh rasterizer.
+static bool bench_clear()
+{
+    const int runs = 20;
+    bool ok = true;
+    auto model = load_model("spot", "../models/spot/spot_triangulated_good.obj");
+    printf("%-10s %14s %14s %12s %8s\n", "size", "full fill(ms)", "fast clear(ms)", "frame(ms)", "image");
+    for (auto [w, h] : {std::pair{700, 700}, std::pair{3840, 2160}})
+    {
+        std::vector<Eigen::Vector3f> color(w * h);
+        std::vector<float> depth(w * h);
+        auto start = Clock::now();
+        for (int run = 0; run < runs; ++run)
+        {
+            std::fill(color.begin(), color.end(), Eigen::Vector3f{0, 0, 0});
+            std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::infinity());
+        }
+        double fill_ms = elapsed_ms(start) / runs;
+
+        rst::rasterizer r(w, h);
+        r.set_clear_color({30, 60, 90});
+        start = Clock::now();
+        for (int run = 0; run < runs; ++run)
+        {
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+        }
+        double clear_ms = elapsed_ms(start) / runs;
+
+        setup_view(r, model, 100.f);
+        r.draw(model.mesh, phong_shader{});
+        setup_view(r, model, 140.f);
+        start = Clock::now();
+        for (int run = 0; run < runs; ++run)
+        {
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+            r.draw(model.mesh, phong_shader{});
+            r.frame_buffer();
+        }
+        double frame_ms = elapsed_ms(start) / runs;
+
+        rst::rasterizer fresh(w, h);
+        fresh.set_clear_color({30, 60, 90});
+        setup_view(fresh, model, 140.f);
+        fresh.clear(rst::Buffers::Color | rst::Buffers::Depth);
+        fresh.draw(model.mesh, phong_shader{});
+        bool match = fresh.frame_buffer() == r.frame_buffer() &&
+                     std::count(r.frame_buffer().begin(), r.frame_buffer().end(), Eigen::Vector3f(30, 60, 90)) > 0;
+        ok = ok && match;
+
+        std::string size = std::to_string(w) + "x" + std::to_string(h);
+        printf("%-10s %14.3f %14.3f %12.2f %8s\n", size.c_str(), fill_ms, clear_ms, frame_ms, match ? "match" : "DIFFER");
+    }
+    return ok;
+}
+
+static std::string read_file(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+// The interactive loop's output stage: draw and write every frame with write_image on the render
+// thread, against handing the frames to an image_writer. With one file per frame and a two-frame
+// queue the writer must apply back-pressure and still write exactly what write_image writes.
+static bool bench_output()
+{
+    const int frames = 30;
+    auto model = load_model("spot", "../models/spot/spot_triangulated_good.obj");
+    auto dir = std::filesystem::temp_directory_path() / "rasterizer_bench_output";
+    std::filesystem::create_directories(dir);
+    auto path = [&](const char* name, int i) { return (dir / (name + std::to_string(i) + ".png")).string(); };
+
+    rst::rasterizer r(700, 700);
+    r.set_format(rst::Format::BGRA8);
+    auto render = [&](int i) {
+        setup_view(r, model, 140.f + 12 * i);
+        r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+        r.draw(model.mesh, phong_shader{});
+        return r.frame_image();
+    };
+
+    // The two stages alone: a writer can at best hide the smaller one behind the larger
+    auto start = Clock::now();
+    for (int i = 0; i < frames; ++i)
+    {
+        render(i);
+    }
+    double render_ms = elapsed_ms(start);
+    cv::Mat last = render(frames - 1).clone();
+    start = Clock::now();
+    for (int i = 0; i < frames; ++i)
+    {
+        rst::write_image(path("encode", 0), last);
+    }
+    double encode_ms = elapsed_ms(start);
+
+    start = Clock::now();
+    for (int i = 0; i < frames; ++i)
+    {
+        rst::write_image(path("sync", i), render(i));
+    }
+    double sync_ms = elapsed_ms(start);
+
+    start = Clock::now();
+    double async_ms, flush_ms;
+    {
+        rst::image_writer writer(2, 2);
+        for (int i = 0; i < frames; ++i)
+        {
+            writer.write(path("async", i), render(i));
+        }
+        async_ms = elapsed_ms(start);
+        writer.flush();
+        flush_ms = elapsed_ms(start);
+    }
+
+    start = Clock::now();
+    int replaced;
+    {
+        rst::image_writer writer(2, 4);
+        for (int i = 0; i < frames; ++i)
+        {
+            writer.write(path("latest", 0), render(i));
+        }
+        writer.flush();
+        replaced = writer.replaced();
+    }
+    double same_file_ms = elapsed_ms(start);
+
+    bool match = true;
+    for (int i = 0; i < frames; ++i)
+    {
+        match = match && read_file(path("sync", i)) == read_file(path("async", i));
+    }
+    match = match && read_file(path("latest", 0)) == read_file(path("sync", frames - 1));
+    std::filesystem::remove_all(dir);
+
+    printf("%d frames, 700x700 phong\n", frames);
+    printf("render alone                     %8.2f ms/frame\n", render_ms / frames);
+    printf("write_image alone                %8.2f ms/frame\n", encode_ms / frames);
+    printf("write_image on the render thread %8.2f ms/frame\n", sync_ms / frames);
+    printf("image_writer, file per frame     %8.2f ms/frame (%.2f with the final flush)\n", async_ms / frames, flush_ms / frames);
+    printf("image_writer, one file           %8.2f ms/frame, %d of %d frames replaced before encoding\n", same_file_ms / frames, replaced, frames);
+    printf("files %s\n", match ? "match" : "DIFFER");
+    return match;
+}
+
+static bool same_vertices(const std::vector<objl::Vertex>& a, const std::vector<objl::Vertex>& b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const objl::Vertex& u, const objl::Vertex& v) {
+        return u.Position == v.Position && u.Normal == v.Normal && u.TextureCoordinate == v.TextureCoordinate;
+    });
+}
+
+static bool same_load(const objl::Loader& a, const objl::Loader& b)
+{
+    if (a.LoadedMeshes.size() != b.LoadedMeshes.size() || !same_vertices(a.LoadedVertices, b.LoadedVertices) ||
+        a.LoadedIndices != b.LoadedIndices)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.LoadedMeshes.size(); ++i)
+    {
+        const auto& m = a.LoadedMeshes[i];
+        const auto& n = b.LoadedMeshes[i];
+        if (m.MeshName != n.MeshName || m.MeshMaterial.name != n.MeshMaterial.name || m.Indices != n.Indices ||
+            !same_vertices(m.Vertices, n.Vertices))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A size x size grid of quads split into two triangles each, with texture coordinates and normals.
+static void write_grid_obj(const std::string& path, int size)
+{
+    std::ofstream out(path);
+    out << "o grid\n";
+    for (int y = 0; y <= size; ++y)
+    {
+        for (int x = 0; x <= size; ++x)
+        {
+            out << "v " << x * 0.01f << ' ' << std::sin(x * 0.1f) * std::cos(y * 0.1f) << ' ' << y * 0.01f << '\n';
+        }
+    }
+    for (int y = 0; y <= size; ++y)
+    {
+        for (int x = 0; x <= size; ++x)
+        {
+            out << "vt " << x / float(size) << ' ' << y / float(size) << '\n';
+        }
+    }
+    out << "vn 0 1 0\n";
+    for (int y = 0; y < size; ++y)
+    {
+        for (int x = 0; x < size; ++x)
+        {
+            int a = y * (size + 1) + x + 1, b = a + 1, c = a + size + 1, d = c + 1;
+            out << "f " << a << '/' << a << "/1 " << b << '/' << b << "/1 " << d << '/' << d << "/1\n";
+            out << "f " << a << '/' << a << "/1 " << d << '/' << d << "/1 " << c << '/' << c << "/1\n";
+        }
+    }
+}
+
+// LoadFile (mapped, in-place parse) against LoadFileStream (the original getline parser) on the
+// bundled models and a generated grid, which must load identically. The grid has
+// RASTERIZER_BENCH_OBJ_TRIANGLES triangles, 2M by default.
+static bool bench_obj()
+{
+    const char* count = std::getenv("RASTERIZER_BENCH_OBJ_TRIANGLES");
+    int grid = std::max(1, (int)std::sqrt((count ? std::atof(count) : 2e6) / 2));
+    auto dir = std::filesystem::temp_directory_path() / "rasterizer_bench_obj";
+    std::filesystem::create_directories(dir);
+    std::string grid_path = (dir / "grid.obj").string();
+    write_grid_obj(grid_path, grid);
+    std::string grid_name = "grid " + std::to_string(2 * grid * grid);
+
+    bool ok = true;
+    printf("%-28s %10s %12s %10s %12s %8s\n", "model", "stream(ms)", "allocations", "mapped(ms)", "allocations", "MB/s");
+    for (auto [name, path] : {std::pair{"cube", std::string("../models/cube/cube.obj")},
+                              std::pair{"crate", std::string("../models/Crate/Crate1.obj")},
+                              std::pair{"bunny", std::string("../models/bunny/bunny.obj")},
+                              std::pair{"rock", std::string("../models/rock/rock.obj")},
+                              std::pair{"spot quads", std::string("../models/spot/spot_quadrangulated.obj")},
+                              std::pair{"spot", std::string("../models/spot/spot_triangulated_good.obj")},
+                              std::pair{grid_name.c_str(), grid_path}})
+    {
+        double size_mb = std::filesystem::file_size(path) / 1e6;
+        auto load = [&](bool mapped, objl::Loader& loader, long* allocations) {
+            long before = allocation_count;
+            auto start = Clock::now();
+            bool loaded = mapped ? loader.LoadFile(path) : loader.LoadFileStream(path);
+            double ms = elapsed_ms(start);
+            *allocations = allocation_count - before;
+            return loaded ? ms : -1;
+        };
+
+        long stream_allocations, mapped_allocations;
+        double stream_ms, mapped_ms;
+        bool match;
+        {
+            objl::Loader stream;
+            stream_ms = load(false, stream, &stream_allocations);
+            objl::Loader mapped;
+            mapped_ms = load(true, mapped, &mapped_allocations);
+            match = stream_ms >= 0 && mapped_ms >= 0 && same_load(stream, mapped);
+        }
+        ok = ok && match;
+        char label[64];
+        snprintf(label, sizeof(label), "%s (%.1f MB)", name, size_mb);
+        printf("%-28s %10.1f %12ld %10.1f %12ld %8.0f%s\n", label,
+               stream_ms, stream_allocations, mapped_ms, mapped_allocations, size_mb / mapped_ms * 1e3, match ? "" : "  DIFFERS");
+    }
+    std::filesystem::remove_all(dir);
+    return ok;
+}
+
+template<typename T>
+static bool same_array(const T* data, const std::vector<T>& expected)
+{
+    return expected.empty() ? data == nullptr : data && std::memcmp(data, expected.data(), expected.size() * sizeof(T)) == 0;
+}
+
+// Startup mesh load: parsing the .obj into a Mesh (what main did on every start) against mapping
+// the binary cache a first load leaves next to it. The mapped arrays must equal the parsed ones and
+// draw the same frame, and touching the .obj must invalidate the cache.
+static bool bench_mesh_cache()
+{
+    auto dir = std::filesystem::temp_directory_path() / "rasterizer_bench_cache";
+    std::filesystem::create_directories(dir);
+    bool ok = true;
+    printf("%-8s %9s %10s %12s %10s %9s %s\n", "model", "vertices", "parse(ms)", "first(ms)", "mapped(ms)", "cache(MB)", "check");
+    for (auto [name, path] : {std::pair{"spot", "../models/spot/spot_triangulated_good.obj"},
+                              std::pair{"bunny", "../models/bunny/bunny.obj"},
+                              std::pair{"rock", "../models/rock/rock.obj"}})
+    {
+        std::string obj = (dir / (std::string(name) + ".obj")).string();
+        std::filesystem::copy_file(path, obj, std::filesystem::copy_options::overwrite_existing);
+        std::filesystem::remove(rst::mesh_cache_path(obj));
+
+        auto start = Clock::now();
+        rst::Mesh parsed = rst::load_obj(obj);
+        double parse_ms = elapsed_ms(start);
+        rst::optimize_mesh(parsed);
+
+        start = Clock::now();
+        bool first_hit = rst::cached_mesh(obj).cache_hit();
+        double first_ms = elapsed_ms(start);
+
+        start = Clock::now();
+        rst::cached_mesh cached(obj);
+        double mapped_ms = elapsed_ms(start);
+
+        const rst::MeshView& view = cached.view();
+        bool match = !first_hit && cached.cache_hit() && view.vertex_count == parsed.positions.size() &&
+                     view.index_count == parsed.indices.size() && same_array(view.positions, parsed.positions) &&
+                     same_array(view.normals, parsed.normals) && same_array(view.tex_coords, parsed.tex_coords) &&
+                     same_array(view.colors, parsed.colors) && same_array(view.indices, parsed.indices);
+
+        auto model = load_model(name, path);
+        rst::rasterizer r(700, 700);
+        auto render = [&](const rst::MeshView& mesh) {
+            setup_view(r, model, 140.f);
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+            r.draw(mesh, phong_shader{});
+            return r.frame_buffer();
+        };
+        match = match && render(parsed) == render(view);
+
+        // An edited .obj is parsed again
+        std::ofstream(obj, std::ios::app) << "# edited\n";
+        match = match && !rst::cached_mesh(obj).cache_hit();
+
+        ok = ok && match;
+        printf("%-8s %9zu %10.2f %12.2f %10.3f %9.1f %s\n", name, view.vertex_count, parse_ms, first_ms, mapped_ms,
+               std::filesystem::file_size(rst::mesh_cache_path(obj)) / 1e6, match ? "match" : "DIFFERS");
+    }
+    std::filesystem::remove_all(dir);
+    return ok;
+}
+
+// The loader's vertex welding: a Mesh with a vertex per face corner (what main used to build)
+// against the indexed Mesh of rst::load_obj. Geometry is the time of a draw with an empty scissor,
+// which transforms every vertex and assembles every triangle but rasterizes nothing. Both meshes
+// must draw the same frame, and the welded one must have as many vertices as weld() finds.
+static bool bench_dedup()
+{
+    const int runs = 50;
+    bool ok = true;
+    printf("%-6s %10s %10s %8s %10s %10s %12s %12s %s\n", "model", "corners", "vertices", "ratio", "load(ms)", "welded(ms)",
+           "geometry(ms)", "welded(ms)", "check");
+    for (auto [name, path] : {std::pair{"spot", "../models/spot/spot_triangulated_good.obj"},
+                              std::pair{"bunny", "../models/bunny/bunny.obj"},
+                              std::pair{"rock", "../models/rock/rock.obj"}})
+    {
+        auto model = load_model(name, path);
+
+        auto start = Clock::now();
+        {
+            objl::Loader loader;
+            loader.LoadFile(path);
+        }
+        double load_ms = elapsed_ms(start);
+        start = Clock::now();
+        rst::Mesh welded = rst::load_obj(path);
+        double welded_load_ms = elapsed_ms(start);
+
+        rst::rasterizer r(700, 700);
+        r.set_fragment_shader(bench_normal_shader);
+        setup_view(r, model, 140.f);
+        auto geometry = [&](const rst::Mesh& mesh) {
+            r.set_scissor({0, 0, 0, 0});
+            auto start = Clock::now();
+            for (int run = 0; run < runs; ++run)
+            {
+                r.draw(mesh);
+            }
+            return elapsed_ms(start) / runs;
+        };
+        auto image = [&](const rst::Mesh& mesh) {
+            r.set_scissor({0, 0, 700, 700});
+            r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+            r.draw(mesh);
+            return r.frame_buffer();
+        };
+        double corner_ms = geometry(model.mesh);
+        double welded_ms = geometry(welded);
+
+        bool match = image(model.mesh) == image(welded) && welded.indices.size() == model.mesh.indices.size() &&
+                     welded.positions.size() == weld(model).positions.size();
+        ok = ok && match;
+        printf("%-6s %10zu %10zu %7.2fx %10.2f %10.2f %12.3f %12.3f %s\n", name, model.mesh.positions.size(), welded.positions.size(),
+               (double)model.mesh.positions.size() / welded.positions.size(), load_ms, welded_load_ms, corner_ms, welded_ms,
+               match ? "match" : "DIFFERS");
+    }
+    return ok;
+}
+
+// Triangle order of the welded mesh: file order, Tipsify alone and Tipsify with the overdraw
+// clusters of optimize_mesh. ACMR is simulated with a 16 entry FIFO (the rasterizer transforms every
+// vertex once and has no post-transform cache). Overdraw is fragments shaded per covered pixel in
+// forward shading with back faces culled, from the rasterizer's counters, over eight views around
+// the model; time is the total for those frames. The frames must differ from file order only where
+// triangles tie in depth.
+static bool bench_reorder()
+{
+    const int views = 8;
+    bool ok = true;
+    printf("%-6s %-18s %8s %10s %12s %10s %10s\n", "model", "order", "ACMR", "overdraw", "hi-z culled", "time(ms)", "changed");
+    for (auto [name, path] : {std::pair{"spot", "../models/spot/spot_triangulated_good.obj"},
+                              std::pair{"bunny", "../models/bunny/bunny.obj"},
+                              std::pair{"rock", "../models/rock/rock.obj"}})
+    {
+        auto model = load_model(name, path);
+        rst::Mesh file_order = rst::load_obj(path);
+        rst::Mesh tipsified = file_order;
+        tipsified.indices = rst::tipsify(file_order.indices, file_order.positions.size(), 16);
+        rst::Mesh optimized = file_order;
+        auto start = Clock::now();
+        rst::optimize_mesh(optimized);
+        double optimize_ms = elapsed_ms(start);
+
+        rst::rasterizer r(700, 700);
+        r.set_fragment_shader(bench_normal_shader);
+        r.set_cull_mode(rst::Cull::Back);
+        std::vector<std::vector<Eigen::Vector3f>> reference;
+        for (auto [order, mesh] : {std::pair{"file", &file_order}, std::pair{"tipsify", &tipsified},
+                                   std::pair{"tipsify+overdraw", &optimized}})
+        {
+            long shaded = 0, pixels = 0, hiz_culled = 0, changed = 0;
+            double ms = 0;
+            for (int view = 0; view < views; ++view)
+            {
+                setup_view(r, model, 360.f * view / views);
+                auto start = Clock::now();
+                r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+                r.draw(*mesh);
+                const auto& frame = r.frame_buffer();
+                ms += elapsed_ms(start);
+
+                shaded += r.stats().fragments_shaded;
+                hiz_culled += r.stats().hiz_pixels_culled;
+                pixels += std::count_if(frame.begin(), frame.end(), [](const Eigen::Vector3f& c) { return c != Eigen::Vector3f::Zero(); });
+                if (reference.size() < views)
+                {
+                    reference.push_back(frame);
+                }
+                for (size_t i = 0; i < frame.size(); ++i)
+                {
+                    changed += frame[i] != reference[view][i];
+                }
+            }
+            // Depth ties resolve by draw order, so a few pixels may change; anything more is a bug
+            bool match = changed * 1000 <= pixels && mesh->indices.size() == file_order.indices.size();
+            ok = ok && match;
+            printf("%-6s %-18s %8.3f %10.3f %12ld %10.2f %10ld%s\n", name, order,
+                   rst::average_cache_miss_ratio(mesh->indices, mesh->positions.size()), double(shaded) / pixels, hiz_culled,
+                   ms, changed, match ? "" : "  DIFFERS");
+        }
+        printf("%-6s optimize_mesh %.2f ms\n", name, optimize_ms);
+    }
+    return ok;
+}
+
+// Levels of detail: the chain built for each model, then frames from increasing distances drawn
+// with the full mesh and with the level select_lod picks. Changed counts the covered pixels whose
+// color differs by more than 8 (of 255) in some channel from all pixels around the same one of the
+// full mesh's frame, so an edge moved by less than a pixel does not count.
+static bool bench_lod()
+{
+    const int runs = 20;
+    bool ok = true;
+    for (auto [name, path] : {std::pair{"spot", "../models/spot/spot_triangulated_good.obj"},
+                              std::pair{"bunny", "../models/bunny/bunny.obj"}})
+    {
+        auto model = load_model(name, path);
+        rst::Mesh mesh = rst::load_obj(path);
+        rst::optimize_mesh(mesh);
+
+        auto start = Clock::now();
+        rst::lod_chain lods(mesh);
+        double build_ms = elapsed_ms(start);
+        printf("%s: %d levels built in %.2f ms\n", name, lods.size(), build_ms);
+        printf("  %-6s %10s %10s %12s\n", "level", "triangles", "vertices", "error");
+        for (int i = 0; i < lods.size(); ++i)
+        {
+            printf("  %-6d %10zu %10zu %12.5f\n", i, lods.level(i).triangle_count(), lods.level(i).vertex_count, lods.error(i));
+        }
+
+        rst::rasterizer r(700, 700);
+        r.set_cull_mode(rst::Cull::Back);
+        printf("  %-9s %8s %6s %10s %10s %10s %9s\n", "distance", "pixels", "level", "triangles", "full(ms)", "lod(ms)", "changed");
+        for (float distance : {10.f, 20.f, 40.f, 80.f, 160.f, 320.f})
+        {
+            r.set_model(get_model_matrix(140.f) * model.normalize);
+            r.set_view(get_view_matrix({0, 0, distance}));
+            r.set_projection(get_projection_matrix(45.0, 1, 0.1, 1000));
+            r.set_near_far(0.1, 1000);
+            auto render = [&](const rst::MeshView& level, double* ms) {
+                auto start = Clock::now();
+                for (int run = 0; run < runs; ++run)
+                {
+                    r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+                    r.draw(level, phong_shader{});
+                }
+                *ms = elapsed_ms(start) / runs;
+                return r.frame_buffer();
+            };
+            double full_ms, lod_ms;
+            auto full = render(lods.level(0), &full_ms);
+            int level = r.select_lod(lods);
+            auto reduced = render(lods.level(level), &lod_ms);
+
+            long pixels = 0, changed = 0;
+            for (int y = 0; y < 700; ++y)
+            {
+                for (int x = 0; x < 700; ++x)
+                {
+                    const Eigen::Vector3f& color = reduced[y * 700 + x];
+                    bool covered = full[y * 700 + x] != Eigen::Vector3f::Zero() || color != Eigen::Vector3f::Zero();
+                    bool near = false;
+                    for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, 699) && !near; ++ny)
+                    {
+                        for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, 699) && !near; ++nx)
+                        {
+                            near = (full[ny * 700 + nx] - color).cwiseAbs().maxCoeff() <= 8;
+                        }
+                    }
+                    pixels += covered;
+                    changed += covered && !near;
+                }
+            }
+            // An error within half a pixel should not change the silhouette or shading of many pixels:
+            // 5% of them, or a few when the model is that small on screen
+            bool match = changed <= std::max(pixels / 20, 8l);
+            ok = ok && match;
+            printf("  %-9.0f %8ld %6d %10zu %10.3f %10.3f %9ld%s\n", distance, pixels, level, lods.level(level).triangle_count(),
+                   full_ms, lod_ms, changed, match ? "" : "  DIFFERS");
+        }
+    }
+    return ok;
+}
+
+// Scene culling: RASTERIZER_BENCH_SCENE_INSTANCES instances (4096 by default) of the bundled models,
+// each drawn through its level of detail chain, scattered over a 400 x 400 field around a camera
+// near the ground. Frames drawn by Scene, which culls whole objects through its hierarchy, must
+// match frames that submit every instance and leave culling to the per-triangle frustum test.
+// Then the hierarchy is timed against a linear box test, and refit and rebuilt as instances move.
+static bool bench_scene()
+{
+    const char* count_env = std::getenv("RASTERIZER_BENCH_SCENE_INSTANCES");
+    const int count = count_env ? std::max(1, std::atoi(count_env)) : 4096;
+    const float field = 200;
+    const int runs = 5;
+
+    struct scene_model
+    {
+        rst::Mesh mesh;
+        std::unique_ptr<rst::lod_chain> lods;
+        std::unique_ptr<Texture> texture;
+        rst::Material material;
+        Eigen::Matrix4f fit;  // centers the mesh and scales it to radius 1
+    };
+    std::vector<scene_model> models;
+    for (auto [path, texture] : {std::pair{"../models/spot/spot_triangulated_good.obj", "../models/spot/spot_texture.png"},
+                                 std::pair{"../models/bunny/bunny.obj", ""},
+                                 std::pair{"../models/rock/rock.obj", "../models/rock/rock.png"},
+                                 std::pair{"../models/Crate/Crate1.obj", ""},
+                                 std::pair{"../models/cube/cube.obj", ""}})
+    {
+        scene_model model;
+        model.mesh = rst::load_obj(path);
+        rst::optimize_mesh(model.mesh);
+        model.lods = std::make_unique<rst::lod_chain>(model.mesh);
+        model.material = rst::Material::Phong;
+        if (*texture)
+        {
+            model.texture = std::make_unique<Texture>(texture);
+            model.material = rst::Material::Texture;
+        }
+        float radius = std::max(1e-6f, model.lods->radius());
+        model.fit = Eigen::Matrix4f::Identity();
+        model.fit.topLeftCorner<3, 3>() /= radius;
+        model.fit.topRightCorner<3, 1>() = -model.lods->center() / radius;
+        models.push_back(std::move(model));
+    }
+
+    std::mt19937 rng(25);
+    std::uniform_real_distribution<float> coordinate(-field, field), angle(0, 360), size(1, 2);
+    std::uniform_int_distribution<int> pick(0, models.size() - 1);
+    auto placement = [&](int m, const Eigen::Vector3f& position) {
+        return get_model_matrix(angle(rng), size(rng), position) * models[m].fit;
+    };
+    rst::Scene scene;
+    std::vector<int> model_of(count);
+    for (int i = 0; i < count; ++i)
+    {
+        model_of[i] = pick(rng);
+        const scene_model& model = models[model_of[i]];
+        scene.add(*model.lods, placement(model_of[i], {coordinate(rng), 0, coordinate(rng)}), model.material, model.texture.get());
+    }
+    auto start = Clock::now();
+    scene.update();
+    printf("%d instances, hierarchy built in %.3f ms\n", count, elapsed_ms(start));
+
+    rst::rasterizer r(700, 700);
+    r.set_cull_mode(rst::Cull::Back);
+    r.set_view(get_view_matrix({0, 3, 0}));
+    r.set_projection(get_projection_matrix(45.0, 1, 0.1, 1000));
+    r.set_near_far(0.1, 1000);
+
+    double scene_ms = 0, all_ms = 0;
+    long scene_triangles = 0, all_triangles = 0;
+    std::vector<Eigen::Vector3f> culled_frame, all_frame;
+    for (int run = 0; run < runs; ++run)
+    {
+        start = Clock::now();
+        r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+        scene.draw(r);
+        scene_ms += elapsed_ms(start);
+        scene_triangles = r.stats().triangles_submitted;
+        culled_frame = r.frame_buffer();
+
+        start = Clock::now();
+        r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+        for (int i = 0; i < scene.size(); ++i)
+        {
+            const rst::Instance& instance = scene.instance(i);
+            r.set_model(instance.model);
+            r.bind_texture(instance.texture);
+            if (instance.material == rst::Material::Texture)
+            {
+                r.draw(*instance.lods, texture_shader{});
+            }
+            else
+            {
+                r.draw(*instance.lods, phong_shader{});
+            }
+        }
+        all_ms += elapsed_ms(start);
+        all_triangles = r.stats().triangles_submitted;
+        all_frame = r.frame_buffer();
+    }
+    bool ok = culled_frame == all_frame;
+    printf("%-10s %10s %12s %12s %10s\n", "draw", "instances", "nodes", "triangles", "frame(ms)");
+    printf("%-10s %10d %12s %12ld %10.2f\n", "all", count, "-", all_triangles, all_ms / runs);
+    printf("%-10s %10ld %12ld %12ld %10.2f%s\n", "culled", scene.stats().instances_drawn, scene.stats().nodes_visited, scene_triangles,
+           scene_ms / runs, ok ? "" : "  FRAMES DIFFER");
+
+    // Culling alone: the hierarchy against a box test per instance
+    const int cull_runs = 200;
+    std::vector<int> visible;
+    start = Clock::now();
+    for (int run = 0; run < cull_runs; ++run)
+    {
+        scene.cull(r, visible);
+    }
+    double tree_us = elapsed_ms(start) * 1e3 / cull_runs;
+    size_t linear_visible = 0;
+    start = Clock::now();
+    for (int run = 0; run < cull_runs; ++run)
+    {
+        linear_visible = 0;
+        for (int i = 0; i < scene.size(); ++i)
+        {
+            linear_visible += r.box_visibility(scene.instance(i).bounds) != rst::Visibility::Outside;
+        }
+    }
+    double linear_us = elapsed_ms(start) * 1e3 / cull_runs;
+    ok = ok && linear_visible == visible.size();
+    printf("cull: hierarchy %.1f us (%ld boxes), linear %.1f us (%d boxes)%s\n", tree_us, scene.stats().nodes_visited, linear_us,
+           scene.size(), linear_visible == visible.size() ? "" : "  VISIBLE SETS DIFFER");
+
+    // Motion: a tenth of the instances take a small step every frame and the tree is refit, until
+    // the boxes have loosened enough for a rebuild
+    // Area ratio: of the tree's boxes to their area after the last build
+    printf("%-8s %10s %10s %12s\n", "frame", "update", "time(ms)", "area ratio");
+    float built_area = scene.tree_area();
+    std::uniform_real_distribution<float> step(-4, 4);
+    for (int frame = 1; frame <= 256; ++frame)
+    {
+        for (int i = frame % 10; i < scene.size(); i += 10)
+        {
+            Eigen::Matrix4f model = scene.instance(i).model;
+            model.topRightCorner<3, 1>() += Eigen::Vector3f(step(rng), 0, step(rng));
+            scene.set_model(i, model);
+        }
+        start = Clock::now();
+        scene.update();
+        double ms = elapsed_ms(start);
+        if (scene.stats().rebuilt)
+        {
+            built_area = scene.tree_area();
+        }
+        if (scene.stats().rebuilt || frame == 1 || frame % 64 == 0)
+        {
+            printf("%-8d %10s %10.3f %12.2f\n", frame, scene.stats().rebuilt ? "rebuild" : "refit", ms, scene.tree_area() / built_area);
+        }
+    }
+
+    // The moved scene still culls exactly
+    r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+    scene.draw(r);
+    scene.cull(r, visible);
+    linear_visible = 0;
+    for (int i = 0; i < scene.size(); ++i)
+    {
+        linear_visible += r.box_visibility(scene.instance(i).bounds) != rst::Visibility::Outside;
+    }
+    ok = ok && linear_visible == visible.size();
+    printf("after motion: %zu visible, linear test %zu%s\n", visible.size(), linear_visible,
+           linear_visible == visible.size() ? "" : "  VISIBLE SETS DIFFER");
+    return ok;
+}
+
+int main(int argc, const char** argv)
+{
+    // Each entry returns false when a correctness check inside it failed.
+    std::vector<std::pair<std::string, std::function<bool()>>> benches = {
+        {"edge", bench_edge_function},
+        {"simd", bench_simd_kernels},
+        {"overdraw", [] { bench_overdraw(); return true; }},
+        {"vertex", bench_vertex_stage},
+        {"mesh", bench_mesh_layout},
+        {"shader", bench_shaders},
+        {"packet", bench_packets},
+        {"uniforms", bench_uniforms},
+        {"texture", [] { bench_texture_filtering(); return true; }},
+        {"swizzle", bench_texture_layout},
+        {"framebuffer", bench_framebuffer},
+        {"clear", bench_clear},
+        {"output", bench_output},
+        {"obj", bench_obj},
+        {"cache", bench_mesh_cache},
+        {"dedup", bench_dedup},
+        {"reorder", bench_reorder},
+        {"lod", bench_lod},
+        {"scene", bench_scene},
+    };
+
+    bool ok = true;
+    std::string filter = argc >= 2 ? argv[1] : "";
+    for (auto& [name, run] : benches)
+    {
+        if (filter.empty() || filter == name)
+        {
+            printf("== %s\n", name.c_str());
+            ok = run() && ok;
+        }
+    }
+    return ok ? 0 : 1;
+}
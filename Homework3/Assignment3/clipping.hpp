@@ -0,0 +1,113 @@
+//
+// Homogeneous clip space: frustum outcodes and polygon clipping.
+//
+
+#pragma once
+
+#include <array>
+#include <eigen3/Eigen/Eigen>
+
+namespace rst
+{
+    // Triangles are only clipped against the x/y planes once they reach this far beyond the viewport;
+    // anything inside the guard band is handled by the clamped raster loops. The limit also keeps the
+    // snapped edge values of triangle_setup exact.
+    constexpr float guard_band_px = 8192;
+
+    // Post-projection vertex with everything that gets interpolated across the triangle.
+    struct clip_vertex
+    {
+        Eigen::Vector4f clip;
+        Eigen::Vector3f view_pos;
+        Eigen::Vector3f normal;
+        Eigen::Vector2f tex_coords;
+        Eigen::Vector3f color;
+    };
+
+    inline clip_vertex lerp(const clip_vertex& a, const clip_vertex& b, float t)
+    {
+        return {a.clip + (b.clip - a.clip) * t, a.view_pos + (b.view_pos - a.view_pos) * t,
+                a.normal + (b.normal - a.normal) * t, a.tex_coords + (b.tex_coords - a.tex_coords) * t,
+                a.color + (b.color - a.color) * t};
+    }
+
+    // Clip planes in homogeneous space, after the vertex has been scaled by the sign that makes w
+    // positive in front of the camera (the homework projection yields w = z_view, which is negative
+    // there; the scaled vertex is the same point). w then is the distance along the view axis.
+    enum clip_plane
+    {
+        Left, Right, Bottom, Top, Near, Far,
+        GuardLeft, GuardRight, GuardBottom, GuardTop,
+        PlaneCount
+    };
+
+    constexpr int frustum_planes = (1 << Left) | (1 << Right) | (1 << Bottom) | (1 << Top) | (1 << Near) | (1 << Far);
+    constexpr int clipped_planes = (1 << Near) | (1 << GuardLeft) | (1 << GuardRight) | (1 << GuardBottom) | (1 << GuardTop);
+
+    struct clip_space
+    {
+        float z_near, z_far;
+        float guard_x, guard_y;  // guard band extent in NDC units of w
+
+        // Signed distance to the plane, positive on the inside.
+        float distance(const Eigen::Vector4f& c, int plane) const
+        {
+            switch (plane)
+            {
+                case Left: return c.w() + c.x();
+                case Right: return c.w() - c.x();
+                case Bottom: return c.w() + c.y();
+                case Top: return c.w() - c.y();
+                case Near: return c.w() - z_near;
+                case Far: return z_far - c.w();
+                case GuardLeft: return guard_x * c.w() + c.x();
+                case GuardRight: return guard_x * c.w() - c.x();
+                case GuardBottom: return guard_y * c.w() + c.y();
+                default: return guard_y * c.w() - c.y();
+            }
+        }
+
+        int outcode(const Eigen::Vector4f& c) const
+        {
+            int code = 0;
+            for (int plane = 0; plane < PlaneCount; ++plane)
+            {
+                code |= (distance(c, plane) < 0) << plane;
+            }
+            return code;
+        }
+    };
+
+    // Sutherland-Hodgman clipping of a convex polygon against the planes in mask.
+    // Three vertices clipped by at most five planes stay below 9 vertices.
+    inline int clip_polygon(std::array<clip_vertex, 9>& poly, int count, int mask, const clip_space& space)
+    {
+        std::array<clip_vertex, 9> out;
+        for (int plane = 0; plane < PlaneCount && count > 0; ++plane)
+        {
+            if (!(mask & (1 << plane)))
+            {
+                continue;
+            }
+            int out_count = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                const auto& a = poly[i];
+                const auto& b = poly[(i + 1) % count];
+                float da = space.distance(a.clip, plane);
+                float db = space.distance(b.clip, plane);
+                if (da >= 0)
+                {
+                    out[out_count++] = a;
+                }
+                if ((da >= 0) != (db >= 0))
+                {
+                    out[out_count++] = lerp(a, b, da / (da - db));
+                }
+            }
+            poly = out;
+            count = out_count;
+        }
+        return count;
+    }
+}
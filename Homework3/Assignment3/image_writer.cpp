@@ -0,0 +1,132 @@
+//
+// Background image encoding: frames are queued and written by worker threads.
+//
+
+#include <algorithm>
+#include <cctype>
+#include "image_writer.hpp"
+
+std::vector<int> rst::image_write_params(const std::string& filename, int level)
+{
+    if (level < 0)
+    {
+        return {};
+    }
+    std::string extension = filename.substr(filename.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (extension == "png")
+    {
+        return {cv::IMWRITE_PNG_COMPRESSION, std::min(level, 9)};
+    }
+    if (extension == "jpg" || extension == "jpeg")
+    {
+        return {cv::IMWRITE_JPEG_QUALITY, std::min(level, 100)};
+    }
+    if (extension == "webp")
+    {
+        return {cv::IMWRITE_WEBP_QUALITY, std::min(level, 100)};
+    }
+    return {};
+}
+
+bool rst::write_image(const std::string& filename, const cv::Mat& image, int level)
+{
+    if (image.channels() != 4)
+    {
+        return cv::imwrite(filename, image, image_write_params(filename, level));
+    }
+    cv::Mat bgr;
+    cv::cvtColor(image, bgr, cv::COLOR_BGRA2BGR);
+    return cv::imwrite(filename, bgr, image_write_params(filename, level));
+}
+
+rst::image_writer::image_writer(int thread_count, int capacity, int level)
+    : level(level), capacity(std::max(1, capacity))
+{
+    for (int i = 0; i < std::max(1, thread_count); ++i)
+    {
+        workers.emplace_back([this] { worker_loop(); });
+    }
+}
+
+rst::image_writer::~image_writer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void rst::image_writer::write(const std::string& filename, const cv::Mat& image)
+{
+    cv::Mat copy = image.clone();
+    std::unique_lock<std::mutex> lock(mutex);
+    auto queued = std::find_if(queue.begin(), queue.end(), [&](const frame& f) { return f.filename == filename; });
+    if (queued != queue.end())
+    {
+        queued->image = copy;
+        replaced_count++;
+        return;
+    }
+
+    space_ready.wait(lock, [this] { return queue.size() < capacity; });
+    queue.push_back({filename, copy});
+    lock.unlock();
+    work_ready.notify_one();
+}
+
+void rst::image_writer::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return queue.empty() && writing.empty(); });
+}
+
+int rst::image_writer::failed() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed_count;
+}
+
+int rst::image_writer::replaced() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return replaced_count;
+}
+
+void rst::image_writer::worker_loop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        // The oldest frame whose file no other worker is writing
+        auto next = queue.end();
+        work_ready.wait(lock, [&] {
+            next = std::find_if(queue.begin(), queue.end(), [&](const frame& f) { return !writing.count(f.filename); });
+            return next != queue.end() || (stopping && queue.empty());
+        });
+        if (next == queue.end())
+        {
+            return;
+        }
+
+        frame f = std::move(*next);
+        queue.erase(next);
+        writing.insert(f.filename);
+        lock.unlock();
+        space_ready.notify_one();
+
+        bool written = write_image(f.filename, f.image, level);
+
+        lock.lock();
+        writing.erase(f.filename);
+        failed_count += !written;
+        // A frame for the same file may have been waiting on this one
+        work_ready.notify_all();
+        idle.notify_all();
+    }
+}
@@ -0,0 +1,76 @@
+//
+// Background image encoding: frames are queued and written by worker threads.
+//
+
+#ifndef RASTERIZER_IMAGE_WRITER_H
+#define RASTERIZER_IMAGE_WRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+namespace rst
+{
+    // cv::imwrite parameters for the format of filename's extension: level is the PNG compression
+    // (0-9) or the JPEG / WebP quality (0-100); negative keeps OpenCV's default.
+    std::vector<int> image_write_params(const std::string& filename, int level);
+
+    // cv::imwrite with image_write_params. A 4-channel image (the rasterizer's BGRA8 frame) is
+    // written as 3-channel BGR: the alpha channel is always opaque and would only grow the file.
+    bool write_image(const std::string& filename, const cv::Mat& image, int level = -1);
+
+    class image_writer
+    {
+    public:
+        // At most capacity frames wait to be encoded; write() blocks while the queue is full. level
+        // is passed to image_write_params for every file.
+        image_writer(int thread_count, int capacity, int level = -1);
+        // Writes everything still queued.
+        ~image_writer();
+
+        image_writer(const image_writer&) = delete;
+        image_writer& operator=(const image_writer&) = delete;
+
+        // Queues a copy of image, so the caller may reuse its buffer right away. A frame still
+        // waiting for the same file is replaced rather than written twice, and writes to one file
+        // never overlap.
+        void write(const std::string& filename, const cv::Mat& image);
+
+        // Returns once every queued frame is written.
+        void flush();
+
+        int failed() const;
+        int replaced() const;
+
+    private:
+        struct frame
+        {
+            std::string filename;
+            cv::Mat image;
+        };
+
+        void worker_loop();
+
+        std::vector<std::thread> workers;
+        int level;
+        size_t capacity;
+
+        mutable std::mutex mutex;
+        std::condition_variable work_ready;
+        std::condition_variable space_ready;
+        std::condition_variable idle;
+
+        std::deque<frame> queue;
+        std::set<std::string> writing;
+        int failed_count = 0;
+        int replaced_count = 0;
+        bool stopping = false;
+    };
+}
+
+#endif //RASTERIZER_IMAGE_WRITER_H
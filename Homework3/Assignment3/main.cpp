@@ -1,5 +1,13 @@
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
 #include <opencv2/opencv.hpp>
 
 #include "global.hpp"
@@ -7,416 +15,376 @@
 #include "Triangle.hpp"
 #include "Shader.hpp"
 #include "Texture.hpp"
-#include "OBJ_Loader.h"
-
-Eigen::Matrix4f get_view_matrix(Eigen::Vector3f eye_pos)
+#include "mesh_cache.hpp"
+#include "scene.hpp"
+#include "transforms.hpp"
+#include "shaders.hpp"
+#include "thread_pool.hpp"
+#include "image_writer.hpp"
+
+// Draws with the raster loops specialized for the named shader; unknown names fall back to phong.
+static void draw_mesh(rst::rasterizer& r, const rst::MeshView& mesh, const std::string& shader)
 {
-    Eigen::Matrix4f view = Eigen::Matrix4f::Identity();
-
-    Eigen::Matrix4f translate;
-    translate << 1,0,0,-eye_pos[0],
-                 0,1,0,-eye_pos[1],
-                 0,0,1,-eye_pos[2],
-                 0,0,0,1;
-
-    view = translate*view;
-
-    return view;
+    if (shader == "texture")
+    {
+        r.draw(mesh, texture_shader{});
+    }
+    else if (shader == "normal")
+    {
+        r.draw(mesh, normal_shader{});
+    }
+    else if (shader == "bump")
+    {
+        r.draw(mesh, bump_shader{});
+    }
+    else if (shader == "displacement")
+    {
+        r.draw(mesh, displacement_shader{});
+    }
+    else
+    {
+        r.draw(mesh, phong_shader{});
+    }
 }
 
-Eigen::Matrix4f get_model_matrix(float angle)
+// The texture shader samples the model's texture, the others the height map.
+static std::string texture_file(const std::string& shader)
 {
-    Eigen::Matrix4f rotation;
-    angle = angle * MY_PI / 180.f;
-    rotation << cos(angle), 0, sin(angle), 0,
-                0, 1, 0, 0,
-                -sin(angle), 0, cos(angle), 0,
-                0, 0, 0, 1;
-
-    Eigen::Matrix4f scale;
-    scale << 2.5, 0, 0, 0,
-              0, 2.5, 0, 0,
-              0, 0, 2.5, 0,
-              0, 0, 0, 1;
-
-    Eigen::Matrix4f translate;
-    translate << 1, 0, 0, 0,
-            0, 1, 0, 0,
-            0, 0, 1, 0,
-            0, 0, 0, 1;
-
-    return translate * rotation * scale;
+    return shader == "texture" ? "spot_texture.png" : "hmap.jpg";
 }
 
-Eigen::Matrix4f get_projection_matrix(float eye_fov, float aspect_ratio, float zNear, float zFar)
+// Options after the output (or job file) arguments, shared by every frame.
+struct render_options
 {
-    // TODO: Use the same projection matrix from the previous assignments
-  float radian = (eye_fov / 365) * (2 * MY_PI);
-  // opencv 中
-  // 右侧是x轴正方向，y轴正方向向下，
-  // 这就导致 y轴和z轴是相反的和推到过程中
-  // 修改分两点
-  // 1：不用写，纠正z轴
-  // zNear = -zNear;
-  // zFar = -zFar;
-  // 2：求yTop的时候乘以 -1，纠正Y轴
-
-  float yTop = -1 * (std::tan(radian / 2) * zNear); // -1 兼容opencv
-  float yBottom = -yTop;
-
-  float xLeft = -1 * ((yTop - yBottom) * aspect_ratio / 2);
-  float xRight = -xLeft;
-
-  Eigen::Matrix4f scale_mat;
-  scale_mat << 2 / (xRight - xLeft), 0, 0, 0, 0, 2 / (yTop - yBottom), 0, 0, 0,
-      0, 2 / (zNear - zFar), 0, 0, 0, 0, 1;
-  // // std::cout << "scale_mat: \n" << scale_mat << std::endl;
-
-  Eigen::Matrix4f move_mat;
-  move_mat << 1, 0, 0, -(xLeft + xRight) / 2, 0, 1, 0, -(yTop + yBottom) / 2, 0,
-      0, 1, -(zFar + zNear) / 2, 0, 0, 0, 1;
-
-  // // std::cout << "move_mat: \n" << move_mat << std::endl;
-
-  Eigen::Matrix4f persp_mat;
-  persp_mat << zNear, 0, 0, 0, 0, zNear, 0, 0, 0, 0, (zFar + zNear),
-      -(zNear * zFar), 0, 0, 1, 0;
-
-  // // std::cout << "persp_mat: \n" << persp_mat << std::endl;
-
-  Eigen::Matrix4f projection = scale_mat * move_mat * persp_mat;
-
-  // std::cout << "projection: \n" << projection << std::endl;
-
-  return projection;
-}
+    bool deferred = false;
+    Texture::Filter filter = Texture::Filter::Nearest;
+    Texture::Layout layout = Texture::Layout::Linear;
+    int level = -1;  // PNG compression or JPEG quality of the written images
+};
 
-Eigen::Vector3f vertex_shader(const vertex_shader_payload& payload)
+static render_options parse_options(int first, int argc, const char** argv)
 {
-    return payload.position;
+    render_options options;
+    for (int i = first; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (option == "deferred")
+        {
+            options.deferred = true;
+        }
+        else if (option == "bilinear")
+        {
+            options.filter = Texture::Filter::Bilinear;
+        }
+        else if (option == "trilinear")
+        {
+            options.filter = Texture::Filter::Trilinear;
+        }
+        else if (option == "swizzled")
+        {
+            options.layout = Texture::Layout::Swizzled;
+        }
+        else if (option.rfind("level=", 0) == 0)
+        {
+            options.level = std::atoi(option.c_str() + 6);
+        }
+    }
+    return options;
 }
 
-Eigen::Vector3f normal_fragment_shader(const fragment_shader_payload& payload)
+static Texture load_texture(const std::string& path, const render_options& options)
 {
-    Eigen::Vector3f return_color = (payload.normal.head<3>().normalized() + Eigen::Vector3f(1.0f, 1.0f, 1.0f)) / 2.f;
-    Eigen::Vector3f result;
-    result << return_color.x() * 255, return_color.y() * 255, return_color.z() * 255;
-    return result;
+    Texture texture(path);
+    texture.filter = options.filter;
+    texture.set_layout(options.layout);
+    return texture;
 }
 
-static Eigen::Vector3f reflect(const Eigen::Vector3f& vec, const Eigen::Vector3f& axis)
+static const Eigen::Vector3f default_eye_pos = {0, 0, 10};
+
+// Sets up r for a frame seen from eye_pos. The shading eye keeps the offset the default uniforms
+// have from the default camera, so the default camera renders exactly as before.
+static void set_camera(rst::rasterizer& r, float angle, const Eigen::Vector3f& eye_pos)
 {
-    auto costheta = vec.dot(axis);
-    return (2 * costheta * axis - vec).normalized();
+    uniform_block uniforms;
+    uniforms.eye_pos += eye_pos - default_eye_pos;
+    r.set_uniforms(uniforms);
+    r.set_model(get_model_matrix(angle));
+    r.set_view(get_view_matrix(eye_pos));
+    r.set_projection(get_projection_matrix(45.0, 1, 0.1, 50));
 }
 
-struct light
+struct render_job
 {
-    Eigen::Vector3f position;
-    Eigen::Vector3f intensity;
+    std::string output;
+    std::string shader;
+    float angle;
+    Eigen::Vector3f eye_pos;
 };
 
-Eigen::Vector3f texture_fragment_shader(const fragment_shader_payload& payload)
+// Job file: one frame per line, "output shader angle [eye_x eye_y eye_z]". Blank lines and lines
+// starting with # are skipped, malformed ones reported and skipped.
+static std::vector<render_job> read_jobs(std::istream& in)
 {
-    Eigen::Vector3f return_color = {0, 0, 0};
-    if (payload.texture)
-    {
-        return_color = payload.texture->getColor(payload.tex_coords[0], payload.tex_coords[1]);
-    }
-    Eigen::Vector3f texture_color;
-    texture_color << return_color.x(), return_color.y(), return_color.z();
-
-    Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
-    Eigen::Vector3f kd = texture_color / 255.f;
-    Eigen::Vector3f ks = Eigen::Vector3f(0.7937, 0.7937, 0.7937);
-
-    auto l1 = light{{20, 20, 20}, {500, 500, 500}};
-    auto l2 = light{{-20, 20, 0}, {500, 500, 500}};
-
-    std::vector<light> lights = {l1, l2};
-    Eigen::Vector3f amb_light_intensity{10, 10, 10};
-    Eigen::Vector3f eye_pos{0, 0, 10};
-
-    float p = 150;
-
-    Eigen::Vector3f color = texture_color;
-    Eigen::Vector3f point = payload.view_pos;
-    Eigen::Vector3f normal = payload.normal;
-
-    Eigen::Vector3f result_color = {0, 0, 0};
-
-    for (auto& light : lights)
+    std::vector<render_job> jobs;
+    std::string line;
+    for (int number = 1; std::getline(in, line); ++number)
     {
-        // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
-        // components are. Then, accumulate that result on the *result_color* object.
-        float r = (point - light.position).norm();
-        auto intensity = light.intensity / (r * r); 
-        Eigen::Vector3f light_dir = (light.position - point).normalized();
-        Eigen::Vector3f eye_dir = (eye_pos - point).normalized();
-        Eigen::Vector3f half_dir = (light_dir + eye_dir).normalized();
-        // 环境光
-        Eigen::Vector3f color_a = ka.cwiseProduct(amb_light_intensity);
-        // 漫反射光
-        Eigen::Vector3f color_d = std::max<float>(0, normal.dot(light_dir)) * kd.cwiseProduct(intensity);
-        // 高光
-        Eigen::Vector3f color_s = std::pow(std::max<float>(0, half_dir.dot(normal)), p) * ks.cwiseProduct(intensity);
-        result_color += (color_a + color_d + color_s); 
+        std::istringstream fields(line);
+        render_job job{"", "", 0, default_eye_pos};
+        if (!(fields >> job.output) || job.output[0] == '#')
+        {
+            continue;
+        }
+        if (!(fields >> job.shader >> job.angle))
+        {
+            std::cerr << "job file line " << number << ": expected output shader angle\n";
+            continue;
+        }
+        Eigen::Vector3f eye;
+        if (fields >> eye.x() >> eye.y() >> eye.z())
+        {
+            job.eye_pos = eye;
+        }
+        jobs.push_back(job);
     }
-
-    return result_color * 255.f;
+    return jobs;
 }
 
-Eigen::Vector3f phong_fragment_shader(const fragment_shader_payload& payload)
+// Renders every job of the file with one load of the mesh and of each texture. Frames are spread
+// over the cores, one single-threaded rasterizer per worker; the mesh and textures are shared
+// read-only. Images are encoded in the background by an image_writer.
+static int run_batch(const std::string& job_path, const rst::MeshView& mesh, const std::string& obj_path, const render_options& options)
 {
-    Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
-    Eigen::Vector3f kd = payload.color;
-    Eigen::Vector3f ks = Eigen::Vector3f(0.7937, 0.7937, 0.7937);
-
-    auto l1 = light{{20, 20, 20}, {500, 500, 500}};
-    auto l2 = light{{-20, 20, 0}, {500, 500, 500}};
-
-    std::vector<light> lights = {l1, l2};
-    Eigen::Vector3f amb_light_intensity{10, 10, 10};
-    Eigen::Vector3f eye_pos{0, 0, 10};
-
-    float p = 150;
+    using Clock = std::chrono::steady_clock;
+    auto ms_since = [](Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    };
 
-    Eigen::Vector3f color = payload.color;
-    Eigen::Vector3f point = payload.view_pos;
-    Eigen::Vector3f normal = payload.normal;
-    // std::cout << "normal:" << normal << std::endl;
-
-
-    Eigen::Vector3f result_color = {0, 0, 0};
-    for (auto& light : lights)
+    std::ifstream file(job_path);
+    if (!file)
     {
-      // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
-      // components are. Then, accumulate that result on the *result_color* object.
-
-      float r = (point - light.position).norm();
-      auto intensity = light.intensity / (r * r); 
-      Eigen::Vector3f light_dir = (light.position - point).normalized();
-      Eigen::Vector3f eye_dir = (eye_pos - point).normalized();
-      Eigen::Vector3f half_dir = (light_dir + eye_dir).normalized();
-
-      // 环境光
-      Eigen::Vector3f color_a = ka.cwiseProduct(amb_light_intensity);
-
-      // 漫反射光
-      Eigen::Vector3f color_d = std::max<float>(0, normal.dot(light_dir)) * kd.cwiseProduct(intensity);
-
-      // 高光
-      Eigen::Vector3f color_s = std::pow(std::max<float>(0, half_dir.dot(normal)), p) * ks.cwiseProduct(intensity);
-
-
-      result_color += (color_a + color_d + color_s); 
+        std::cerr << "cannot open job file " << job_path << "\n";
+        return 1;
     }
+    std::vector<render_job> jobs = read_jobs(file);
 
-    return result_color * 255.f;
-}
-
-
-
-Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload& payload)
-{
-    
-    Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
-    Eigen::Vector3f kd = payload.color;
-    Eigen::Vector3f ks = Eigen::Vector3f(0.7937, 0.7937, 0.7937);
-
-    auto l1 = light{{20, 20, 20}, {500, 500, 500}};
-    auto l2 = light{{-20, 20, 0}, {500, 500, 500}};
-
-    std::vector<light> lights = {l1, l2};
-    Eigen::Vector3f amb_light_intensity{10, 10, 10};
-    Eigen::Vector3f eye_pos{0, 0, 10};
-
-    float p = 150;
-
-    Eigen::Vector3f color = payload.color; 
-    Eigen::Vector3f point = payload.view_pos;
-    Eigen::Vector3f normal = payload.normal;
-
-    float kh = 0.2, kn = 0.1;
-    
-    // TODO: Implement displacement mapping here
-    // Let n = normal = (x, y, z)
-    // Vector t = (x*y/sqrt(x*x+z*z),sqrt(x*x+z*z),z*y/sqrt(x*x+z*z))
-    // Vector b = n cross product t
-    // Matrix TBN = [t b n]
-    // dU = kh * kn * (h(u+1/w,v)-h(u,v))
-    // dV = kh * kn * (h(u,v+1/h)-h(u,v))
-    // Vector ln = (-dU, -dV, 1)
-    // Position p = p + kn * n * h(u,v)
-    // Normal n = normalize(TBN * ln)
-
-
-    Eigen::Vector3f result_color = {0, 0, 0};
+    auto start = Clock::now();
+    std::map<std::string, Texture> textures;
+    for (const auto& job : jobs)
+    {
+        std::string name = texture_file(job.shader);
+        if (!textures.count(name))
+        {
+            textures.emplace(name, load_texture(obj_path + name, options));
+        }
+    }
+    double load_ms = ms_since(start);
 
-    for (auto& light : lights)
+    rst::thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::unique_ptr<rst::rasterizer>> rasterizers;
+    std::vector<rst::rasterizer*> idle;
+    for (int i = 0; i < pool.size(); ++i)
     {
-        // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
-        // components are. Then, accumulate that result on the *result_color* object.
+        rasterizers.push_back(std::make_unique<rst::rasterizer>(700, 700));
+        rst::rasterizer& r = *rasterizers.back();
+        r.set_near_far(0.1, 50);
+        r.set_cull_mode(rst::Cull::Back);
+        r.set_format(rst::Format::BGRA8);
+        r.set_vertex_shader(vertex_shader);
+        if (options.deferred)
+        {
+            r.set_shading(rst::Shading::Deferred);
+        }
+        idle.push_back(&r);
+    }
+    std::mutex idle_mutex;
 
+    rst::image_writer writer(pool.size(), 2 * pool.size(), options.level);
+    std::vector<double> job_ms(jobs.size());
+    start = Clock::now();
+    pool.parallel_for(jobs.size(), [&](int i) {
+        rst::rasterizer* r;
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            r = idle.back();
+            idle.pop_back();
+        }
 
+        auto job_start = Clock::now();
+        const render_job& job = jobs[i];
+        r->bind_texture(&textures.at(texture_file(job.shader)));
+        r->clear(rst::Buffers::Color | rst::Buffers::Depth);
+        set_camera(*r, job.angle, job.eye_pos);
+        draw_mesh(*r, mesh, job.shader);
+        writer.write(job.output, r->frame_image());
+        job_ms[i] = ms_since(job_start);
+
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        idle.push_back(r);
+    });
+    writer.flush();
+    double total_ms = ms_since(start);
+
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        std::cout << jobs[i].output << ": " << jobs[i].shader << " at " << jobs[i].angle << " degrees, " << job_ms[i] << " ms\n";
     }
-
-    return result_color * 255.f;
+    std::cout << jobs.size() << " frames in " << total_ms << " ms on " << pool.size() << " threads ("
+              << textures.size() << " textures loaded in " << load_ms << " ms)\n";
+    if (writer.failed() > 0)
+    {
+        std::cerr << writer.failed() << " frames could not be written\n";
+        return 1;
+    }
+    return 0;
 }
 
-
-Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload& payload)
+// Model matrix that centers a mesh on the origin and scales it to radius 1, from its bounds.
+static Eigen::Matrix4f unit_size(const Eigen::AlignedBox3f& bounds)
 {
-    Eigen::Vector3f ka = Eigen::Vector3f(0.005, 0.005, 0.005);
-    Eigen::Vector3f kd = payload.color;
-    Eigen::Vector3f ks = Eigen::Vector3f(0.7937, 0.7937, 0.7937);
-
-    auto l1 = light{{20, 20, 20}, {500, 500, 500}};
-    auto l2 = light{{-20, 20, 0}, {500, 500, 500}};
-
-    std::vector<light> lights = {l1, l2};
-    Eigen::Vector3f amb_light_intensity{10, 10, 10};
-    Eigen::Vector3f eye_pos{0, 0, 10};
-
-    float p = 150;
-
-    Eigen::Vector3f color = payload.color;
-    Eigen::Vector3f point = payload.view_pos;
-    Eigen::Vector3f normal = payload.normal;
-
-    float kh = 0.2, kn = 0.1;
-
-    // TODO: Implement bump mapping here
-    // Let n = normal = (x, y, z)
-    // Vector t = (x*y/sqrt(x*x+z*z),sqrt(x*x+z*z),z*y/sqrt(x*x+z*z))
-    // Vector b = n cross product t
-    // Matrix TBN = [t b n]
-    // dU = kh * kn * (h(u+1/w,v)-h(u,v))
-    // dV = kh * kn * (h(u,v+1/h)-h(u,v))
-    // Vector ln = (-dU, -dV, 1)
-    // Normal n = normalize(TBN * ln)
-
-    float x = normal.x();
-    float y = normal.y();
-    float z = normal.z();
-
-    // Eigen::Vector3f t = Eigen::Vector3f(x * y / std::sqrt(x * x + z * z), std::sqrt(x * x + z * z), z * y / std::sqrt(x * x + z * z));
-    Eigen::Vector3f t = Eigen::Vector3f(-y / std::sqrt(x * x + y * y), x / sqrt(x * x + y * y), 0);
-
-    Eigen::Vector3f b = normal.cross(t);
-
-    Eigen::Matrix3f TBN;
-    TBN << t.x(), b.x(), normal.x(),
-        t.y(), b.y(), normal.y(),
-        t.z(), b.z(), normal.z();
-
-    float u = payload.tex_coords.x();
-    float v = payload.tex_coords.y();
-    float w = payload.texture->width;
-    float h = payload.texture->height;
-
-    float dU = kh * kn * (payload.texture->getColor(u + 1.0f / w, v).norm() - payload.texture->getColor(u, v).norm());
-    float dV = kh * kn * (payload.texture->getColor(u, v + 1.0f / h).norm() - payload.texture->getColor(u, v).norm());
-
-    Eigen::Vector3f ln = Eigen::Vector3f(-dU, -dV, 1.0f);
-    normal = TBN * ln;
+    float radius = std::max(1e-6f, 0.5f * bounds.diagonal().norm());
+    Eigen::Matrix4f fit = Eigen::Matrix4f::Identity();
+    fit.topLeftCorner<3, 3>() /= radius;
+    fit.topRightCorner<3, 1>() = -bounds.center() / radius;
+    return fit;
+}
 
-    Eigen::Vector3f result_color = {0, 0, 0};
-    result_color = normal.normalized();
+// Scene mode: every model of ../models/ side by side in one frame, through rst::Scene.
+static int run_scene(const std::string& output, float angle, const render_options& options)
+{
+    struct scene_model
+    {
+        std::string obj, texture;
+        rst::Material material;
+    };
+    const std::vector<scene_model> models = {
+        {"../models/spot/spot_triangulated_good.obj", "../models/spot/spot_texture.png", rst::Material::Texture},
+        {"../models/bunny/bunny.obj", "", rst::Material::Phong},
+        {"../models/rock/rock.obj", "../models/rock/rock.png", rst::Material::Texture},
+        {"../models/Crate/Crate1.obj", "../models/Crate/crate_1.jpg", rst::Material::Texture},
+        {"../models/cube/cube.obj", "../models/cube/wall.tif", rst::Material::Texture},
+    };
+
+    std::vector<std::unique_ptr<rst::cached_mesh>> meshes;
+    std::vector<std::unique_ptr<Texture>> textures;
+    rst::Scene scene;
+    for (size_t i = 0; i < models.size(); ++i)
+    {
+        meshes.push_back(std::make_unique<rst::cached_mesh>(models[i].obj));
+        const Texture* texture = nullptr;
+        if (!models[i].texture.empty())
+        {
+            textures.push_back(std::make_unique<Texture>(load_texture(models[i].texture, options)));
+            texture = textures.back().get();
+        }
+        Eigen::Vector3f position(2.2f * (i - (models.size() - 1) / 2.f), 0, 0);
+        scene.add(meshes.back()->view(), get_model_matrix(angle, 0.9f, position) * unit_size(meshes.back()->bounds()),
+                  models[i].material, texture);
+    }
 
-    return result_color * 255.f;
+    rst::rasterizer r(700, 700);
+    r.set_thread_count(std::max(1u, std::thread::hardware_concurrency()));
+    r.set_near_far(0.1, 50);
+    r.set_cull_mode(rst::Cull::Back);
+    r.set_format(rst::Format::BGRA8);
+    r.set_vertex_shader(vertex_shader);
+    if (options.deferred)
+    {
+        r.set_shading(rst::Shading::Deferred);
+    }
+    r.clear(rst::Buffers::Color | rst::Buffers::Depth);
+    set_camera(r, angle, {0, 0, 14});
+    scene.draw(r);
+    rst::write_image(output, r.frame_image(), options.level);
+
+    std::cout << "instances: " << scene.stats().instances_drawn << " drawn, " << scene.stats().instances_culled << " culled\n";
+    std::cout << "triangles: " << r.stats().triangles_submitted << " submitted, " << r.stats().triangles_frustum_culled
+              << " frustum culled, " << r.stats().triangles_face_culled << " face culled\n";
+    return 0;
 }
 
 int main(int argc, const char** argv)
 {
-    std::vector<Triangle*> TriangleList;
-
     float angle = 140.0;
     bool command_line = false;
 
     std::string filename = "output.png";
-    objl::Loader Loader;
     std::string obj_path = "../models/spot/";
 
-    // Load .obj File
-    bool loadout = Loader.LoadFile("../models/spot/spot_triangulated_good.obj");
-    for(auto mesh:Loader.LoadedMeshes)
+    // Load .obj File, through the binary cache written next to it on the first run
+    rst::cached_mesh model("../models/spot/spot_triangulated_good.obj");
+    const rst::MeshView& mesh = model.view();
+
+    // Scene mode: Rasterizer --scene <output> [options]
+    if (argc >= 3 && std::string(argv[1]) == "--scene")
     {
-        for(int i=0;i<mesh.Vertices.size();i+=3)
-        {
-            Triangle* t = new Triangle();
-            for(int j=0;j<3;j++)
-            {
-                t->setVertex(j,Vector4f(mesh.Vertices[i+j].Position.X,mesh.Vertices[i+j].Position.Y,mesh.Vertices[i+j].Position.Z,1.0));
-                t->setNormal(j,Vector3f(mesh.Vertices[i+j].Normal.X,mesh.Vertices[i+j].Normal.Y,mesh.Vertices[i+j].Normal.Z));
-                t->setTexCoord(j,Vector2f(mesh.Vertices[i+j].TextureCoordinate.X, mesh.Vertices[i+j].TextureCoordinate.Y));
-            }
-            TriangleList.push_back(t);
-        }
+        return run_scene(argv[2], angle, parse_options(3, argc, argv));
     }
 
-    rst::rasterizer r(700, 700);
+    // Batch mode: Rasterizer --batch <job file> [options]
+    if (argc >= 3 && std::string(argv[1]) == "--batch")
+    {
+        return run_batch(argv[2], mesh, obj_path, parse_options(3, argc, argv));
+    }
 
-    auto texture_path = "hmap.jpg";
-    r.set_texture(Texture(obj_path + texture_path));
+    rst::rasterizer r(700, 700);
+    r.set_thread_count(std::max(1u, std::thread::hardware_concurrency()));
+    r.set_near_far(0.1, 50);
+    r.set_cull_mode(rst::Cull::Back);
+    // Pixels are stored as displayable BGRA bytes, so frames go to OpenCV without conversion
+    r.set_format(rst::Format::BGRA8);
 
-    std::function<Eigen::Vector3f(fragment_shader_payload)> active_shader = phong_fragment_shader;
+    std::string shader = "phong";
+    render_options options;
 
     if (argc >= 2)
     {
         command_line = true;
         filename = std::string(argv[1]);
 
-        if (argc == 3 && std::string(argv[2]) == "texture")
-        {
-            // std::cout << "Rasterizing using the texture shader\n";
-            active_shader = texture_fragment_shader;
-            texture_path = "spot_texture.png";
-            r.set_texture(Texture(obj_path + texture_path));
-        }
-        else if (argc == 3 && std::string(argv[2]) == "normal")
-        {
-            // std::cout << "Rasterizing using the normal shader\n";
-            active_shader = normal_fragment_shader;
-        }
-        else if (argc == 3 && std::string(argv[2]) == "phong")
-        {
-            // std::cout << "Rasterizing using the phong shader\n";
-            active_shader = phong_fragment_shader;
-        }
-        else if (argc == 3 && std::string(argv[2]) == "bump")
+        if (argc >= 3)
         {
-            // std::cout << "Rasterizing using the bump shader\n";
-            active_shader = bump_fragment_shader;
-        }
-        else if (argc == 3 && std::string(argv[2]) == "displacement")
-        {
-            // std::cout << "Rasterizing using the bump shader\n";
-            active_shader = displacement_fragment_shader;
+            shader = argv[2];
         }
+
+        // Options: deferred shading, texture filtering and layout
+        options = parse_options(3, argc, argv);
+    }
+    if (options.deferred)
+    {
+        r.set_shading(rst::Shading::Deferred);
     }
 
-    Eigen::Vector3f eye_pos = {0,0,10};
+    r.set_texture(load_texture(obj_path + texture_file(shader), options));
+
+    Eigen::Vector3f eye_pos = default_eye_pos;
 
     r.set_vertex_shader(vertex_shader);
-    r.set_fragment_shader(active_shader);
 
     int key = 0;
     int frame_count = 0;
 
+    // Encodes frames in the background while the next one renders; a frame still queued for the
+    // file is replaced by the newer one.
+    rst::image_writer writer(2, 4, options.level);
+
     if (command_line)
     {
         r.clear(rst::Buffers::Color | rst::Buffers::Depth);
-        r.set_model(get_model_matrix(angle));
-        r.set_view(get_view_matrix(eye_pos));
-        r.set_projection(get_projection_matrix(45.0, 1, 0.1, 50));
+        set_camera(r, angle, eye_pos);
+
+        draw_mesh(r, mesh, shader);
+        cv::Mat image = r.frame_image();
 
-        r.draw(TriangleList);
-        cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
-        image.convertTo(image, CV_8UC3, 1.0f);
-        cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+        rst::write_image(filename, image, options.level);
 
-        cv::imwrite(filename, image);
+        const auto& stats = r.stats();
+        std::cout << "triangles: " << stats.triangles_submitted << " submitted, " << stats.triangles_frustum_culled
+                  << " frustum culled, " << stats.triangles_face_culled << " face culled\n";
+        std::cout << "hi-z: " << stats.hiz_blocks_culled << " of " << stats.hiz_blocks_tested
+                  << " blocks culled, " << stats.hiz_pixels_culled << " pixels skipped\n";
+        std::cout << "fragments shaded: " << stats.fragments_shaded << "\n";
 
         return 0;
     }
@@ -425,18 +393,14 @@ int main(int argc, const char** argv)
     {
         r.clear(rst::Buffers::Color | rst::Buffers::Depth);
 
-        r.set_model(get_model_matrix(angle));
-        r.set_view(get_view_matrix(eye_pos));
-        r.set_projection(get_projection_matrix(45.0, 1, 0.1, 50));
+        set_camera(r, angle, eye_pos);
 
         //r.draw(pos_id, ind_id, col_id, rst::Primitive::Triangle);
-        r.draw(TriangleList);
-        cv::Mat image(700, 700, CV_32FC3, r.frame_buffer().data());
-        image.convertTo(image, CV_8UC3, 1.0f);
-        cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+        draw_mesh(r, mesh, shader);
+        cv::Mat image = r.frame_image();
 
         cv::imshow("image", image);
-        cv::imwrite(filename, image);
+        writer.write(filename, image);
         key = cv::waitKey(10);
 
         if (key == 'a' )
@@ -0,0 +1,63 @@
+//
+// Indexed triangle mesh in structure-of-arrays layout.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <eigen3/Eigen/Eigen>
+
+namespace rst
+{
+    // One contiguous array per vertex attribute and three indices per triangle, counter clockwise
+    // like Triangle. normals, tex_coords and colors are either empty or as long as positions;
+    // colors are in the 0-1 range of Triangle::color.
+    struct Mesh
+    {
+        std::vector<Eigen::Vector3f> positions;
+        std::vector<Eigen::Vector3f> normals;
+        std::vector<Eigen::Vector2f> tex_coords;
+        std::vector<Eigen::Vector3f> colors;
+        std::vector<uint32_t> indices;
+
+        size_t vertex_count() const { return positions.size(); }
+        size_t triangle_count() const { return indices.size() / 3; }
+
+        // Bytes held by the arrays (their sizes, not capacities).
+        size_t memory_bytes() const
+        {
+            return positions.size() * sizeof(positions[0]) + normals.size() * sizeof(normals[0]) +
+                   tex_coords.size() * sizeof(tex_coords[0]) + colors.size() * sizeof(colors[0]) +
+                   indices.size() * sizeof(indices[0]);
+        }
+    };
+
+    // Non-owning view of the arrays of a Mesh, or of the same arrays in a memory-mapped mesh cache
+    // (mesh_cache.hpp). Absent attributes are null. Converts implicitly from Mesh, so everything that
+    // draws a MeshView also draws a Mesh.
+    struct MeshView
+    {
+        const Eigen::Vector3f* positions = nullptr;
+        const Eigen::Vector3f* normals = nullptr;
+        const Eigen::Vector2f* tex_coords = nullptr;
+        const Eigen::Vector3f* colors = nullptr;
+        const uint32_t* indices = nullptr;
+        size_t vertex_count = 0;
+        size_t index_count = 0;
+
+        MeshView() = default;
+        MeshView(const Mesh& mesh)
+            : positions(mesh.positions.data()),
+              normals(mesh.normals.empty() ? nullptr : mesh.normals.data()),
+              tex_coords(mesh.tex_coords.empty() ? nullptr : mesh.tex_coords.data()),
+              colors(mesh.colors.empty() ? nullptr : mesh.colors.data()),
+              indices(mesh.indices.data()),
+              vertex_count(mesh.positions.size()),
+              index_count(mesh.indices.size())
+        {
+        }
+
+        size_t triangle_count() const { return index_count / 3; }
+    };
+}
@@ -0,0 +1,224 @@
+//
+// Binary mesh cache: a Mesh stored as raw arrays next to its .obj, memory mapped on later loads.
+//
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include "mesh_cache.hpp"
+#include "mesh_optimize.hpp"
+#include "OBJ_Loader.h"
+
+namespace
+{
+    const char cache_magic[8] = {'R', 'S', 'T', 'M', 'E', 'S', 'H', 0};
+    const uint32_t cache_version = 3;
+
+    size_t align16(size_t offset)
+    {
+        return (offset + 15) & ~size_t(15);
+    }
+
+    // Size and modification time of the .obj, stored in the cache to detect edits. False when the
+    // .obj cannot be read.
+    bool source_stamp(const std::string& obj_path, uint64_t* size, int64_t* time)
+    {
+        std::error_code error;
+        *size = std::filesystem::file_size(obj_path, error);
+        if (error)
+        {
+            return false;
+        }
+        *time = std::filesystem::last_write_time(obj_path, error).time_since_epoch().count();
+        return !error;
+    }
+
+    // Byte offsets of the arrays of a cache with this header, and the total file size.
+    struct cache_layout
+    {
+        size_t positions, normals, tex_coords, colors, indices, size;
+
+        explicit cache_layout(const rst::mesh_cache_header& header)
+        {
+            size_t vertices = header.vertex_count;
+            positions = align16(sizeof(rst::mesh_cache_header));
+            normals = align16(positions + vertices * sizeof(Eigen::Vector3f));
+            size_t end = header.attributes & rst::mesh_cache_header::has_normals ? normals + vertices * sizeof(Eigen::Vector3f) : normals;
+            tex_coords = align16(end);
+            end = header.attributes & rst::mesh_cache_header::has_tex_coords ? tex_coords + vertices * sizeof(Eigen::Vector2f) : tex_coords;
+            colors = align16(end);
+            end = header.attributes & rst::mesh_cache_header::has_colors ? colors + vertices * sizeof(Eigen::Vector3f) : colors;
+            indices = align16(end);
+            size = indices + header.index_count * sizeof(uint32_t);
+        }
+    };
+}
+
+rst::Mesh rst::load_obj(const std::string& obj_path)
+{
+    Mesh mesh;
+    objl::Loader loader;
+    loader.DeduplicateVertices = true;
+    loader.LoadFile(obj_path);
+    mesh.positions.reserve(loader.LoadedVertices.size());
+    mesh.normals.reserve(loader.LoadedVertices.size());
+    mesh.tex_coords.reserve(loader.LoadedVertices.size());
+    mesh.colors.reserve(loader.LoadedVertices.size());
+    mesh.indices.reserve(loader.LoadedIndices.size());
+    for (const auto& loaded : loader.LoadedMeshes)
+    {
+        uint32_t offset = mesh.positions.size();
+        for (const auto& vertex : loaded.Vertices)
+        {
+            mesh.positions.emplace_back(vertex.Position.X, vertex.Position.Y, vertex.Position.Z);
+            mesh.normals.emplace_back(vertex.Normal.X, vertex.Normal.Y, vertex.Normal.Z);
+            mesh.tex_coords.emplace_back(vertex.TextureCoordinate.X, vertex.TextureCoordinate.Y);
+            mesh.colors.emplace_back(148 / 255., 121 / 255., 92 / 255.);
+        }
+        for (unsigned int index : loaded.Indices)
+        {
+            mesh.indices.push_back(offset + index);
+        }
+    }
+    return mesh;
+}
+
+std::string rst::mesh_cache_path(const std::string& obj_path)
+{
+    return std::filesystem::path(obj_path).replace_extension(".mesh").string();
+}
+
+bool rst::write_mesh_cache(const std::string& obj_path, const Mesh& mesh)
+{
+    mesh_cache_header header = {};
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    if (!source_stamp(obj_path, &header.source_size, &header.source_time))
+    {
+        return false;
+    }
+    header.attributes = (mesh.normals.empty() ? 0 : mesh_cache_header::has_normals) |
+                        (mesh.tex_coords.empty() ? 0 : mesh_cache_header::has_tex_coords) |
+                        (mesh.colors.empty() ? 0 : mesh_cache_header::has_colors);
+    header.vertex_count = mesh.positions.size();
+    header.index_count = mesh.indices.size();
+
+    Eigen::AlignedBox3f bounds;
+    for (const auto& p : mesh.positions)
+    {
+        bounds.extend(p);
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        header.bounds_min[i] = mesh.positions.empty() ? 0 : bounds.min()[i];
+        header.bounds_max[i] = mesh.positions.empty() ? 0 : bounds.max()[i];
+    }
+
+    cache_layout layout(header);
+    std::vector<char> bytes(layout.size, 0);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    auto copy = [&](size_t offset, const auto& array) {
+        if (!array.empty())
+        {
+            std::memcpy(bytes.data() + offset, array.data(), array.size() * sizeof(array[0]));
+        }
+    };
+    copy(layout.positions, mesh.positions);
+    copy(layout.normals, mesh.normals);
+    copy(layout.tex_coords, mesh.tex_coords);
+    copy(layout.colors, mesh.colors);
+    copy(layout.indices, mesh.indices);
+
+    // A name of its own per writer, so concurrent writers never share the temporary file
+    std::string path = mesh_cache_path(obj_path);
+    std::string temporary = path + "." + std::to_string(std::random_device{}()) + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        out.write(bytes.data(), bytes.size());
+    }
+    std::error_code error;
+    if (std::filesystem::file_size(temporary, error) != bytes.size())
+    {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+rst::cached_mesh::cached_mesh(const std::string& obj_path)
+{
+    if (map_cache(obj_path))
+    {
+        hit = true;
+        return;
+    }
+
+    parsed = load_obj(obj_path);
+    optimize_mesh(parsed);
+    mesh_view = parsed;
+    mesh_bounds.setEmpty();
+    for (const auto& p : parsed.positions)
+    {
+        mesh_bounds.extend(p);
+    }
+    write_mesh_cache(obj_path, parsed);
+}
+
+rst::cached_mesh::~cached_mesh() = default;
+
+bool rst::cached_mesh::map_cache(const std::string& obj_path)
+{
+    uint64_t source_size;
+    int64_t source_time;
+    if (!source_stamp(obj_path, &source_size, &source_time))
+    {
+        return false;
+    }
+
+    auto mapped = std::make_unique<objl::MappedFile>(mesh_cache_path(obj_path));
+    std::string_view bytes = mapped->View();
+    if (bytes.size() < sizeof(mesh_cache_header))
+    {
+        return false;
+    }
+    mesh_cache_header header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != cache_version ||
+        header.source_size != source_size || header.source_time != source_time)
+    {
+        return false;
+    }
+    cache_layout layout(header);
+    if (layout.size != bytes.size())
+    {
+        return false;
+    }
+
+    const char* base = bytes.data();
+    mesh_view.positions = reinterpret_cast<const Eigen::Vector3f*>(base + layout.positions);
+    if (header.attributes & mesh_cache_header::has_normals)
+    {
+        mesh_view.normals = reinterpret_cast<const Eigen::Vector3f*>(base + layout.normals);
+    }
+    if (header.attributes & mesh_cache_header::has_tex_coords)
+    {
+        mesh_view.tex_coords = reinterpret_cast<const Eigen::Vector2f*>(base + layout.tex_coords);
+    }
+    if (header.attributes & mesh_cache_header::has_colors)
+    {
+        mesh_view.colors = reinterpret_cast<const Eigen::Vector3f*>(base + layout.colors);
+    }
+    mesh_view.indices = reinterpret_cast<const uint32_t*>(base + layout.indices);
+    mesh_view.vertex_count = header.vertex_count;
+    mesh_view.index_count = header.index_count;
+    mesh_bounds = Eigen::AlignedBox3f(Eigen::Vector3f::Map(header.bounds_min), Eigen::Vector3f::Map(header.bounds_max));
+    file = std::move(mapped);
+    return true;
+}
@@ -0,0 +1,82 @@
+//
+// Binary mesh cache: a Mesh stored as raw arrays next to its .obj, memory mapped on later loads.
+//
+
+#ifndef RASTERIZER_MESH_CACHE_H
+#define RASTERIZER_MESH_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <eigen3/Eigen/Eigen>
+
+#include "mesh.hpp"
+
+namespace objl
+{
+    class MappedFile;
+}
+
+namespace rst
+{
+    // File layout, in native byte order: this header, then positions, normals, tex_coords, colors
+    // and indices as the float / uint32 arrays of Mesh, each starting at a multiple of 16 bytes.
+    // Absent attributes take no space. source_size and source_time identify the .obj the cache was
+    // built from, so an edited .obj is parsed again.
+    struct mesh_cache_header
+    {
+        static constexpr uint32_t has_normals = 1, has_tex_coords = 2, has_colors = 4;
+
+        char magic[8];
+        uint32_t version;
+        uint32_t attributes;  // has_* bits
+        uint64_t vertex_count;
+        uint64_t index_count;
+        uint64_t source_size;
+        int64_t source_time;
+        float bounds_min[3];
+        float bounds_max[3];
+    };
+
+    // The triangles of an OBJ file, indexed: corners with the same position, texture coordinate and
+    // normal share a vertex. All colored (148, 121, 92) / 255 like draw(TriangleList).
+    Mesh load_obj(const std::string& obj_path);
+
+    // Cache file used for obj_path: the same name with the extension replaced by .mesh.
+    std::string mesh_cache_path(const std::string& obj_path);
+
+    // Writes mesh to a cache for obj_path. The file is written under a temporary name and renamed, so
+    // processes loading the same model at once never map a partial file. False if it cannot be written.
+    bool write_mesh_cache(const std::string& obj_path, const Mesh& mesh);
+
+    class cached_mesh
+    {
+    public:
+        // Maps the cache of obj_path when it matches the .obj; otherwise parses the .obj, reorders it
+        // with optimize_mesh and writes the cache. When the cache cannot be written the parsed mesh
+        // is kept in memory instead.
+        explicit cached_mesh(const std::string& obj_path);
+        ~cached_mesh();
+
+        cached_mesh(const cached_mesh&) = delete;
+        cached_mesh& operator=(const cached_mesh&) = delete;
+
+        // The arrays, inside the mapping when there is one. Valid while this object lives.
+        const MeshView& view() const { return mesh_view; }
+        const Eigen::AlignedBox3f& bounds() const { return mesh_bounds; }
+
+        // Whether the mesh came from an existing cache, without parsing the .obj.
+        bool cache_hit() const { return hit; }
+
+    private:
+        bool map_cache(const std::string& obj_path);
+
+        std::unique_ptr<objl::MappedFile> file;
+        Mesh parsed;
+        MeshView mesh_view;
+        Eigen::AlignedBox3f mesh_bounds;
+        bool hit = false;
+    };
+}
+
+#endif //RASTERIZER_MESH_CACHE_H
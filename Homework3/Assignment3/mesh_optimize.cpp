@@ -0,0 +1,290 @@
+//
+// Triangle and vertex reordering of an indexed Mesh for vertex reuse and less overdraw.
+//
+
+#include <algorithm>
+#include <numeric>
+#include "mesh_optimize.hpp"
+
+namespace
+{
+    // FIFO post-transform cache: a vertex enters when it misses and leaves cache_size misses later.
+    struct fifo_cache
+    {
+        std::vector<long> entered;  // miss count when each vertex last entered, -inf when never
+        long misses = 0;
+        int size;
+
+        fifo_cache(size_t vertex_count, int size) : entered(vertex_count, -(1l << 40)), size(size) {}
+
+        // True on a miss
+        bool access(uint32_t v)
+        {
+            if (misses - entered[v] < size)
+            {
+                return false;
+            }
+            entered[v] = misses++;
+            return true;
+        }
+    };
+}
+
+float rst::average_cache_miss_ratio(const std::vector<uint32_t>& indices, size_t vertex_count, int cache_size)
+{
+    if (indices.size() < 3)
+    {
+        return 0;
+    }
+    fifo_cache cache(vertex_count, cache_size);
+    for (uint32_t v : indices)
+    {
+        cache.access(v);
+    }
+    return float(cache.misses) / (indices.size() / 3);
+}
+
+std::vector<uint32_t> rst::tipsify(const std::vector<uint32_t>& indices, size_t vertex_count, int cache_size,
+                                   std::vector<size_t>* clusters)
+{
+    size_t triangle_count = indices.size() / 3;
+
+    // Triangles around each vertex, as offsets into one array
+    std::vector<uint32_t> live(vertex_count, 0);
+    for (size_t i = 0; i < 3 * triangle_count; ++i)
+    {
+        live[indices[i]]++;
+    }
+    std::vector<size_t> adjacency_start(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; ++v)
+    {
+        adjacency_start[v + 1] = adjacency_start[v] + live[v];
+    }
+    std::vector<uint32_t> adjacency(adjacency_start.back());
+    std::vector<size_t> fill(adjacency_start.begin(), adjacency_start.end() - 1);
+    for (size_t t = 0; t < triangle_count; ++t)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            adjacency[fill[indices[3 * t + j]]++] = t;
+        }
+    }
+
+    std::vector<uint32_t> out;
+    out.reserve(3 * triangle_count);
+    std::vector<char> emitted(triangle_count, 0);
+    // Time stamp of each vertex's last entry in the cache; the time advances on every miss
+    std::vector<long> cache_time(vertex_count, 0);
+    long time = cache_size + 1;
+    std::vector<uint32_t> dead_end;
+    std::vector<uint32_t> candidates;
+    size_t cursor = 0;
+    if (clusters)
+    {
+        clusters->clear();
+    }
+
+    // Next fanning vertex after a dead end: the most recent vertex that still has triangles, else
+    // the first one in input order. Starts a new cluster.
+    auto skip_dead_end = [&]() -> long {
+        if (clusters)
+        {
+            clusters->push_back(out.size() / 3);
+        }
+        while (!dead_end.empty())
+        {
+            uint32_t v = dead_end.back();
+            dead_end.pop_back();
+            if (live[v] > 0)
+            {
+                return v;
+            }
+        }
+        for (; cursor < vertex_count; ++cursor)
+        {
+            if (live[cursor] > 0)
+            {
+                return cursor;
+            }
+        }
+        return -1;
+    };
+
+    long fan = vertex_count > 0 ? skip_dead_end() : -1;
+    while (fan >= 0)
+    {
+        candidates.clear();
+        for (size_t a = adjacency_start[fan]; a < adjacency_start[fan + 1]; ++a)
+        {
+            uint32_t t = adjacency[a];
+            if (emitted[t])
+            {
+                continue;
+            }
+            emitted[t] = 1;
+            for (int j = 0; j < 3; ++j)
+            {
+                uint32_t v = indices[3 * t + j];
+                out.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cache_time[v] > cache_size)
+                {
+                    cache_time[v] = time++;
+                }
+            }
+        }
+
+        // The candidate that will still be cached after its remaining triangles are emitted (each
+        // adds up to two vertices) and has been in the cache longest; any live one otherwise.
+        long next = -1;
+        long best = -1;
+        for (uint32_t v : candidates)
+        {
+            if (live[v] == 0)
+            {
+                continue;
+            }
+            long priority = 0;
+            if (time - cache_time[v] + 2 * live[v] <= cache_size)
+            {
+                priority = time - cache_time[v];
+            }
+            if (priority > best)
+            {
+                best = priority;
+                next = v;
+            }
+        }
+        fan = next >= 0 ? next : skip_dead_end();
+    }
+    if (clusters)
+    {
+        // The last skip found nothing: it marks the end
+        clusters->back() = triangle_count;
+    }
+    return out;
+}
+
+void rst::optimize_mesh(Mesh& mesh, int cache_size, float overdraw_threshold)
+{
+    size_t vertex_count = mesh.positions.size();
+    size_t triangle_count = mesh.indices.size() / 3;
+    if (triangle_count == 0)
+    {
+        return;
+    }
+
+    std::vector<size_t> hard;
+    std::vector<uint32_t> indices = tipsify(mesh.indices, vertex_count, cache_size, &hard);
+
+    // Clusters: the Tipsify restarts, split again as soon as a cluster's own miss ratio, counted from
+    // an empty cache since any cluster may end up drawn first, is within overdraw_threshold of the
+    // ratio of the whole Tipsify order. Reordering such clusters keeps the ACMR about that close.
+    float target = overdraw_threshold * average_cache_miss_ratio(indices, vertex_count, cache_size);
+    std::vector<size_t> starts;
+    fifo_cache cache(vertex_count, cache_size);
+    size_t next_hard = 0;
+    long cluster_misses = 0;
+    size_t cluster_start = 0;
+    for (size_t t = 0; t < triangle_count; ++t)
+    {
+        bool restart = t == hard[next_hard];
+        if (restart)
+        {
+            next_hard++;
+        }
+        if (restart || t == cluster_start)
+        {
+            if (starts.empty() || starts.back() != t)
+            {
+                starts.push_back(t);
+            }
+            cluster_start = t;
+            cluster_misses = 0;
+            // Empties the cache: every vertex entered at least cache_size misses ago
+            cache.misses += cache_size;
+        }
+        for (int j = 0; j < 3; ++j)
+        {
+            cluster_misses += cache.access(indices[3 * t + j]);
+        }
+        if (cluster_misses <= target * (t + 1 - cluster_start))
+        {
+            cluster_start = t + 1;
+        }
+    }
+    starts.push_back(triangle_count);
+
+    // Sort key of a cluster: how far its area-weighted centroid lies out from the mesh center along
+    // its average normal. Outer, outward-facing clusters are drawn first.
+    auto triangle = [&](size_t t, int j) { return mesh.positions[indices[3 * t + j]]; };
+    Eigen::Vector3f center = Eigen::Vector3f::Zero();
+    float total_area = 0;
+    for (size_t t = 0; t < triangle_count; ++t)
+    {
+        float area = (triangle(t, 1) - triangle(t, 0)).cross(triangle(t, 2) - triangle(t, 0)).norm();
+        center += area * (triangle(t, 0) + triangle(t, 1) + triangle(t, 2)) / 3;
+        total_area += area;
+    }
+    center /= std::max(total_area, 1e-20f);
+
+    size_t cluster_count = starts.size() - 1;
+    std::vector<float> key(cluster_count);
+    for (size_t c = 0; c < cluster_count; ++c)
+    {
+        Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+        Eigen::Vector3f normal = Eigen::Vector3f::Zero();
+        float area = 0;
+        for (size_t t = starts[c]; t < starts[c + 1]; ++t)
+        {
+            Eigen::Vector3f n = (triangle(t, 1) - triangle(t, 0)).cross(triangle(t, 2) - triangle(t, 0));
+            centroid += n.norm() * (triangle(t, 0) + triangle(t, 1) + triangle(t, 2)) / 3;
+            area += n.norm();
+            normal += n;
+        }
+        centroid /= std::max(area, 1e-20f);
+        key[c] = (centroid - center).dot(normal.normalized());
+    }
+    std::vector<size_t> order(cluster_count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return key[a] > key[b]; });
+
+    mesh.indices.clear();
+    for (size_t c : order)
+    {
+        mesh.indices.insert(mesh.indices.end(), indices.begin() + 3 * starts[c], indices.begin() + 3 * starts[c + 1]);
+    }
+
+    // Renumber vertices in order of first use, so vertex fetch walks the arrays forward
+    std::vector<uint32_t> remap(vertex_count, UINT32_MAX);
+    uint32_t used = 0;
+    for (uint32_t& v : mesh.indices)
+    {
+        if (remap[v] == UINT32_MAX)
+        {
+            remap[v] = used++;
+        }
+        v = remap[v];
+    }
+    auto permute = [&](auto& array) {
+        if (array.empty())
+        {
+            return;
+        }
+        auto old = array;
+        array.resize(used);
+        for (size_t v = 0; v < vertex_count; ++v)
+        {
+            if (remap[v] != UINT32_MAX)
+            {
+                array[remap[v]] = old[v];
+            }
+        }
+    };
+    permute(mesh.positions);
+    permute(mesh.normals);
+    permute(mesh.tex_coords);
+    permute(mesh.colors);
+}
@@ -0,0 +1,36 @@
+//
+// Triangle and vertex reordering of an indexed Mesh for vertex reuse and less overdraw.
+//
+
+#ifndef RASTERIZER_MESH_OPTIMIZE_H
+#define RASTERIZER_MESH_OPTIMIZE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "mesh.hpp"
+
+namespace rst
+{
+    // Average cache miss ratio: vertices transformed per triangle by a FIFO post-transform cache of
+    // cache_size entries, like the one of GPUs. 3 without any reuse, about 0.5 at best on a large
+    // closed mesh.
+    float average_cache_miss_ratio(const std::vector<uint32_t>& indices, size_t vertex_count, int cache_size = 16);
+
+    // Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced
+    // Overdraw", 2007): triangles are emitted in fans around vertices chosen to still be in a cache
+    // of cache_size entries. Returns the new index buffer; *clusters, when given, receives the offset
+    // (in triangles) of every point where the walk had to restart away from the cache, plus the end.
+    std::vector<uint32_t> tipsify(const std::vector<uint32_t>& indices, size_t vertex_count, int cache_size,
+                                  std::vector<size_t>* clusters = nullptr);
+
+    // Reorders mesh in place: Tipsify for vertex reuse, then its clusters, split further as soon as
+    // their miss ratio is within overdraw_threshold times that of the Tipsify order, are sorted so the
+    // ones facing outward from the mesh center come first and occlude the rest from most view
+    // directions. Vertices are finally
+    // renumbered in order of first use, dropping unused ones. Triangles keep their winding; only the
+    // order changes.
+    void optimize_mesh(Mesh& mesh, int cache_size = 16, float overdraw_threshold = 1.05f);
+}
+
+#endif //RASTERIZER_MESH_OPTIMIZE_H
@@ -0,0 +1,491 @@
+//
+// Quadric edge-collapse simplification and the chain of levels of detail drawn by screen size.
+//
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <queue>
+#include "mesh_simplify.hpp"
+
+namespace
+{
+    // Symmetric 4x4 matrix of a sum of squared distances to planes, upper triangle by rows.
+    struct quadric
+    {
+        double q[10] = {};
+
+        // Plane through p with unit normal n
+        static quadric plane(const Eigen::Vector3d& n, const Eigen::Vector3d& p)
+        {
+            double d = -n.dot(p);
+            quadric result;
+            double v[4] = {n.x(), n.y(), n.z(), d};
+            for (int i = 0, k = 0; i < 4; ++i)
+            {
+                for (int j = i; j < 4; ++j)
+                {
+                    result.q[k++] = v[i] * v[j];
+                }
+            }
+            return result;
+        }
+
+        quadric& operator+=(const quadric& other)
+        {
+            for (int i = 0; i < 10; ++i)
+            {
+                q[i] += other.q[i];
+            }
+            return *this;
+        }
+
+        double evaluate(const Eigen::Vector3f& p) const
+        {
+            double x = p.x(), y = p.y(), z = p.z();
+            return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x + q[4] * y * y + 2 * q[5] * y * z +
+                   2 * q[6] * y + q[7] * z * z + 2 * q[8] * z + q[9];
+        }
+    };
+
+    // Ids for values that are equal bit for bit, in order of first occurrence.
+    template<size_t N>
+    std::vector<uint32_t> weld_keys(const std::vector<std::array<uint32_t, N>>& keys, uint32_t* count)
+    {
+        std::vector<uint32_t> order(keys.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+        std::vector<uint32_t> first(keys.size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            first[order[i]] = i > 0 && keys[order[i]] == keys[order[i - 1]] ? first[order[i - 1]] : order[i];
+        }
+        std::vector<uint32_t> ids(keys.size(), UINT32_MAX), renumber(keys.size(), UINT32_MAX);
+        *count = 0;
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            if (renumber[first[i]] == UINT32_MAX)
+            {
+                renumber[first[i]] = (*count)++;
+            }
+            ids[i] = renumber[first[i]];
+        }
+        return ids;
+    }
+
+    template<size_t N>
+    void put(std::array<uint32_t, N>& key, size_t at, const float* values, int count)
+    {
+        std::memcpy(key.data() + at, values, count * sizeof(float));
+    }
+
+    // Edge collapse state. Attribute vertices (ids into the input) are grouped by position; the
+    // topology, quadrics and collapses work on the groups, and triangle corners keep attribute ids.
+    class simplifier
+    {
+    public:
+        explicit simplifier(const rst::MeshView& mesh) : mesh(mesh)
+        {
+            size_t triangle_count = mesh.triangle_count();
+            faceted = mesh.normals != nullptr;
+            for (size_t t = 0; t < triangle_count && faceted; ++t)
+            {
+                const auto& n = mesh.normals[mesh.indices[3 * t]];
+                faceted = n == mesh.normals[mesh.indices[3 * t + 1]] && n == mesh.normals[mesh.indices[3 * t + 2]];
+            }
+
+            // Attribute vertices: the input vertices, welded where equal. A faceted mesh's normals
+            // are left out, so its corners weld by position.
+            std::vector<std::array<uint32_t, 11>> keys(mesh.vertex_count);
+            std::vector<std::array<uint32_t, 3>> positions(mesh.vertex_count);
+            for (size_t v = 0; v < mesh.vertex_count; ++v)
+            {
+                keys[v].fill(0);
+                put(keys[v], 0, mesh.positions[v].data(), 3);
+                put(positions[v], 0, mesh.positions[v].data(), 3);
+                if (mesh.normals && !faceted)
+                {
+                    put(keys[v], 3, mesh.normals[v].data(), 3);
+                }
+                if (mesh.tex_coords)
+                {
+                    put(keys[v], 6, mesh.tex_coords[v].data(), 2);
+                }
+                if (mesh.colors)
+                {
+                    put(keys[v], 8, mesh.colors[v].data(), 3);
+                }
+            }
+            uint32_t attribute_count, group_count;
+            std::vector<uint32_t> attribute_of = weld_keys(keys, &attribute_count);
+            std::vector<uint32_t> group_of_vertex = weld_keys(positions, &group_count);
+            source.assign(attribute_count, 0);
+            group.assign(attribute_count, 0);
+            for (size_t v = mesh.vertex_count; v-- > 0;)
+            {
+                source[attribute_of[v]] = v;
+                group[attribute_of[v]] = group_of_vertex[v];
+            }
+            group_position.resize(group_count);
+            for (size_t v = 0; v < mesh.vertex_count; ++v)
+            {
+                group_position[group_of_vertex[v]] = mesh.positions[v];
+            }
+
+            triangles.resize(triangle_count);
+            alive.assign(triangle_count, 0);
+            group_triangles.resize(group_count);
+            quadrics.resize(group_count);
+            for (size_t t = 0; t < triangle_count; ++t)
+            {
+                for (int j = 0; j < 3; ++j)
+                {
+                    triangles[t][j] = attribute_of[mesh.indices[3 * t + j]];
+                }
+                uint32_t g0 = group_of(t, 0), g1 = group_of(t, 1), g2 = group_of(t, 2);
+                if (g0 == g1 || g1 == g2 || g2 == g0)
+                {
+                    continue;
+                }
+                alive[t] = 1;
+                live++;
+                Eigen::Vector3d p0 = group_position[g0].cast<double>();
+                Eigen::Vector3d n = (group_position[g1].cast<double>() - p0).cross(group_position[g2].cast<double>() - p0);
+                quadric plane = n.norm() > 0 ? quadric::plane(n.normalized(), p0) : quadric();
+                for (uint32_t g : {g0, g1, g2})
+                {
+                    group_triangles[g].push_back(t);
+                    quadrics[g] += plane;
+                }
+            }
+
+            // Open borders and non-manifold edges stay where they are: their groups never move
+            locked.assign(group_count, 0);
+            std::vector<std::pair<uint32_t, uint32_t>> edges;
+            for (size_t t = 0; t < triangle_count; ++t)
+            {
+                for (int j = 0; alive[t] && j < 3; ++j)
+                {
+                    uint32_t a = group_of(t, j), b = group_of(t, (j + 1) % 3);
+                    edges.emplace_back(std::min(a, b), std::max(a, b));
+                }
+            }
+            std::sort(edges.begin(), edges.end());
+            for (size_t i = 0; i < edges.size();)
+            {
+                size_t j = i;
+                while (j < edges.size() && edges[j] == edges[i])
+                {
+                    j++;
+                }
+                if (j - i != 2)
+                {
+                    locked[edges[i].first] = locked[edges[i].second] = 1;
+                }
+                i = j;
+            }
+
+            version.assign(group_count, 0);
+            for (uint32_t g = 0; g < group_count; ++g)
+            {
+                push_edges(g);
+            }
+        }
+
+        size_t triangle_count() const { return live; }
+        // Largest quadric error of the collapses made, as a distance
+        float error() const { return std::sqrt(max_error); }
+
+        void collapse_to(size_t target)
+        {
+            while (live > target && !candidates.empty())
+            {
+                candidate c = candidates.top();
+                candidates.pop();
+                if (version[c.from] != c.from_version || version[c.to] != c.to_version || !try_collapse(c.from, c.to))
+                {
+                    continue;
+                }
+                max_error = std::max(max_error, c.cost);
+            }
+        }
+
+        // The surviving triangles; vertices in order of first use, or three per triangle with fresh
+        // face normals when the input was faceted.
+        rst::Mesh extract() const
+        {
+            rst::Mesh out;
+            std::vector<uint32_t> remap(source.size(), UINT32_MAX);
+            for (size_t t = 0; t < triangles.size(); ++t)
+            {
+                if (!alive[t])
+                {
+                    continue;
+                }
+                Eigen::Vector3f face_normal;
+                if (faceted)
+                {
+                    // The normal objl generates for a face without normals
+                    const auto& p0 = mesh.positions[source[triangles[t][0]]];
+                    const auto& p1 = mesh.positions[source[triangles[t][1]]];
+                    const auto& p2 = mesh.positions[source[triangles[t][2]]];
+                    face_normal = (p0 - p1).cross(p2 - p1);
+                }
+                for (uint32_t a : triangles[t])
+                {
+                    if (!faceted && remap[a] != UINT32_MAX)
+                    {
+                        out.indices.push_back(remap[a]);
+                        continue;
+                    }
+                    remap[a] = out.positions.size();
+                    out.indices.push_back(remap[a]);
+                    uint32_t v = source[a];
+                    out.positions.push_back(mesh.positions[v]);
+                    if (mesh.normals)
+                    {
+                        out.normals.push_back(faceted ? face_normal : mesh.normals[v]);
+                    }
+                    if (mesh.tex_coords)
+                    {
+                        out.tex_coords.push_back(mesh.tex_coords[v]);
+                    }
+                    if (mesh.colors)
+                    {
+                        out.colors.push_back(mesh.colors[v]);
+                    }
+                }
+            }
+            return out;
+        }
+
+    private:
+        struct candidate
+        {
+            double cost;
+            uint32_t from, to;
+            uint32_t from_version, to_version;
+
+            bool operator>(const candidate& other) const { return cost > other.cost; }
+        };
+
+        uint32_t group_of(size_t t, int corner) const { return group[triangles[t][corner]]; }
+
+        int corner_of(size_t t, uint32_t g) const
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                if (group_of(t, j) == g)
+                {
+                    return j;
+                }
+            }
+            return -1;
+        }
+
+        // Both directions of every edge around g, at the current quadrics
+        void push_edges(uint32_t g)
+        {
+            for (uint32_t t : group_triangles[g])
+            {
+                for (int j = 0; alive[t] && j < 3; ++j)
+                {
+                    uint32_t n = group_of(t, j);
+                    if (n == g)
+                    {
+                        continue;
+                    }
+                    for (auto [from, to] : {std::pair{g, n}, std::pair{n, g}})
+                    {
+                        if (!locked[from])
+                        {
+                            quadric sum = quadrics[from];
+                            sum += quadrics[to];
+                            candidates.push({std::max(0.0, sum.evaluate(group_position[to])), from, to, version[from], version[to]});
+                        }
+                    }
+                }
+            }
+        }
+
+        // Groups sharing a live triangle with g
+        void neighbors(uint32_t g, std::vector<uint32_t>& out) const
+        {
+            out.clear();
+            for (uint32_t t : group_triangles[g])
+            {
+                for (int j = 0; alive[t] && j < 3; ++j)
+                {
+                    if (group_of(t, j) != g)
+                    {
+                        out.push_back(group_of(t, j));
+                    }
+                }
+            }
+            std::sort(out.begin(), out.end());
+            out.erase(std::unique(out.begin(), out.end()), out.end());
+        }
+
+        // Moves group from onto group to if that keeps seams, topology and orientation.
+        bool try_collapse(uint32_t from, uint32_t to)
+        {
+            // Each attribute vertex at from must have one counterpart at to, found across the edge:
+            // a vertex of a seam has one only along the seam, so seams slide along themselves.
+            mapping.clear();
+            int edge_triangles = 0;
+            for (uint32_t t : group_triangles[from])
+            {
+                int b = alive[t] ? corner_of(t, to) : -1;
+                if (b < 0)
+                {
+                    continue;
+                }
+                edge_triangles++;
+                uint32_t a = triangles[t][corner_of(t, from)];
+                auto known = std::find_if(mapping.begin(), mapping.end(), [&](const auto& m) { return m.first == a; });
+                if (known == mapping.end())
+                {
+                    mapping.emplace_back(a, triangles[t][b]);
+                }
+                else if (known->second != triangles[t][b])
+                {
+                    return false;
+                }
+            }
+            if (edge_triangles == 0)
+            {
+                return false;
+            }
+
+            // Link condition: the ends share no neighbor besides the edge's opposite vertices
+            neighbors(from, from_neighbors);
+            neighbors(to, to_neighbors);
+            shared.clear();
+            std::set_intersection(from_neighbors.begin(), from_neighbors.end(), to_neighbors.begin(), to_neighbors.end(),
+                                  std::back_inserter(shared));
+            if ((int)shared.size() != edge_triangles)
+            {
+                return false;
+            }
+
+            for (uint32_t t : group_triangles[from])
+            {
+                if (!alive[t] || corner_of(t, to) >= 0)
+                {
+                    continue;
+                }
+                int corner = corner_of(t, from);
+                uint32_t a = triangles[t][corner];
+                if (std::none_of(mapping.begin(), mapping.end(), [&](const auto& m) { return m.first == a; }))
+                {
+                    return false;
+                }
+                // No triangle may turn over
+                Eigen::Vector3f p[3] = {group_position[group_of(t, 0)], group_position[group_of(t, 1)], group_position[group_of(t, 2)]};
+                Eigen::Vector3f before = (p[1] - p[0]).cross(p[2] - p[0]);
+                p[corner] = group_position[to];
+                Eigen::Vector3f after = (p[1] - p[0]).cross(p[2] - p[0]);
+                if (before.dot(after) <= 0)
+                {
+                    return false;
+                }
+            }
+
+            for (uint32_t t : group_triangles[from])
+            {
+                if (!alive[t])
+                {
+                    continue;
+                }
+                if (corner_of(t, to) >= 0)
+                {
+                    alive[t] = 0;
+                    live--;
+                    continue;
+                }
+                uint32_t& a = triangles[t][corner_of(t, from)];
+                a = std::find_if(mapping.begin(), mapping.end(), [&](const auto& m) { return m.first == a; })->second;
+                group_triangles[to].push_back(t);
+            }
+            group_triangles[from].clear();
+            quadrics[to] += quadrics[from];
+            version[from]++;
+            version[to]++;
+            push_edges(to);
+            return true;
+        }
+
+        const rst::MeshView& mesh;
+        bool faceted;
+
+        std::vector<uint32_t> source;  // input vertex of each attribute vertex
+        std::vector<uint32_t> group;   // position group of each attribute vertex
+        std::vector<Eigen::Vector3f> group_position;
+        std::vector<std::vector<uint32_t>> group_triangles;
+        std::vector<quadric> quadrics;
+        std::vector<char> locked;
+        std::vector<uint32_t> version;
+
+        std::vector<std::array<uint32_t, 3>> triangles;  // attribute vertices
+        std::vector<char> alive;
+        size_t live = 0;
+
+        std::priority_queue<candidate, std::vector<candidate>, std::greater<candidate>> candidates;
+        double max_error = 0;
+
+        // Scratch of try_collapse
+        std::vector<std::pair<uint32_t, uint32_t>> mapping;
+        std::vector<uint32_t> from_neighbors, to_neighbors, shared;
+    };
+}
+
+rst::Mesh rst::simplify_mesh(const MeshView& mesh, size_t target_triangles, float* error)
+{
+    simplifier s(mesh);
+    s.collapse_to(target_triangles);
+    if (error)
+    {
+        *error = s.error();
+    }
+    return s.extract();
+}
+
+rst::lod_chain::lod_chain(const MeshView& mesh, size_t min_triangles)
+{
+    Eigen::AlignedBox3f bounds;
+    for (size_t v = 0; v < mesh.vertex_count; ++v)
+    {
+        bounds.extend(mesh.positions[v]);
+    }
+    sphere_center = mesh.vertex_count > 0 ? Eigen::Vector3f(bounds.center()) : Eigen::Vector3f::Zero();
+    sphere_radius = 0;
+    for (size_t v = 0; v < mesh.vertex_count; ++v)
+    {
+        sphere_radius = std::max(sphere_radius, (mesh.positions[v] - sphere_center).norm());
+    }
+
+    // One simplification run, stopped at every halving, so each level's error covers all the
+    // collapses since level 0
+    errors.push_back(0);
+    simplifier s(mesh);
+    size_t previous = mesh.triangle_count();
+    while (previous / 2 >= min_triangles)
+    {
+        s.collapse_to(previous / 2);
+        if (4 * s.triangle_count() > 3 * previous)
+        {
+            break;
+        }
+        meshes.push_back(s.extract());
+        errors.push_back(s.error());
+        previous = s.triangle_count();
+    }
+
+    levels.push_back(mesh);
+    for (const auto& m : meshes)
+    {
+        levels.push_back(m);
+    }
+}
@@ -0,0 +1,56 @@
+//
+// Quadric edge-collapse simplification and the chain of levels of detail drawn by screen size.
+//
+
+#ifndef RASTERIZER_MESH_SIMPLIFY_H
+#define RASTERIZER_MESH_SIMPLIFY_H
+
+#include <cstddef>
+#include <vector>
+#include <eigen3/Eigen/Eigen>
+
+#include "mesh.hpp"
+
+namespace rst
+{
+    // Collapses edges of mesh, cheapest first by the quadric error metric of Garland and Heckbert,
+    // until at most target_triangles remain or no collapse is allowed. Every collapse moves one end
+    // of an edge onto the other, so the surviving vertices keep their exact attributes. Collapses
+    // that would cross a UV or normal seam (vertices sharing a position with different attributes),
+    // move an open border, fold the surface or flip a triangle are refused. A faceted mesh (the
+    // three corners of every triangle carry its face normal, as the loader generates for an OBJ
+    // without normals) is simplified by position and gets fresh face normals. *error, when given,
+    // receives an estimate of the largest distance the surface moved, in model units.
+    Mesh simplify_mesh(const MeshView& mesh, size_t target_triangles, float* error = nullptr);
+
+    // A mesh and successively simplified versions of it, about half the triangles each, for drawing
+    // far away objects with fewer triangles (rasterizer::draw(const lod_chain&, ...)).
+    class lod_chain
+    {
+    public:
+        // Level 0 is mesh itself, which must outlive the chain. Levels stop below min_triangles or
+        // when simplification no longer halves the previous level.
+        explicit lod_chain(const MeshView& mesh, size_t min_triangles = 64);
+
+        lod_chain(const lod_chain&) = delete;
+        lod_chain& operator=(const lod_chain&) = delete;
+
+        int size() const { return (int)levels.size(); }
+        const MeshView& level(int i) const { return levels[i]; }
+        // Estimated largest distance between level i and level 0, in model units.
+        float error(int i) const { return errors[i]; }
+
+        // Bounding sphere of level 0, in model space.
+        const Eigen::Vector3f& center() const { return sphere_center; }
+        float radius() const { return sphere_radius; }
+
+    private:
+        std::vector<Mesh> meshes;
+        std::vector<MeshView> levels;
+        std::vector<float> errors;
+        Eigen::Vector3f sphere_center;
+        float sphere_radius;
+    };
+}
+
+#endif //RASTERIZER_MESH_SIMPLIFY_H
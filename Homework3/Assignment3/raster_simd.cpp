@@ -0,0 +1,216 @@
+//
+// Span kernels: coverage, depth test and attribute interpolation for up to 8 pixels of a row.
+//
+
+#include "raster_simd.hpp"
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define RST_HAS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    unsigned span_scalar(const rst::triangle_setup& setup, const rst::triangle_attributes& attributes,
+                         int x, int y, int count, const float* depth, rst::fragment_lanes& out)
+    {
+        unsigned mask = 0;
+        double e[3] = {setup.edge(0, x, y), setup.edge(1, x, y), setup.edge(2, x, y)};
+        for (int lane = 0; lane < count; ++lane, e[0] += setup.a[0], e[1] += setup.a[1], e[2] += setup.a[2])
+        {
+            if (e[0] > 0 && e[1] > 0 && e[2] > 0)
+            {
+                auto [alpha, beta, gamma] = setup.barycentric(e);
+                float z = alpha * attributes.z[0] + beta * attributes.z[1] + gamma * attributes.z[2];
+                if (z < depth[lane])
+                {
+                    mask |= 1u << lane;
+                    out.alpha[lane] = alpha;
+                    out.beta[lane] = beta;
+                    out.gamma[lane] = gamma;
+                    out.z[lane] = z;
+                    for (int k = 0; k < rst::attribute_count; ++k)
+                    {
+                        const float* a = attributes.attr[k];
+                        out.attr[k][lane] = a[0] * alpha + a[1] * beta + a[2] * gamma;
+                    }
+                }
+            }
+        }
+        return mask;
+    }
+
+#ifdef RST_HAS_X86_SIMD
+    // Lanes past count read +-inf depth so they never pass the test.
+    inline void load_depth(const float* depth, int count, float* lanes)
+    {
+        for (int lane = 0; lane < rst::span_width; ++lane)
+        {
+            lanes[lane] = lane < count ? depth[lane] : -std::numeric_limits<float>::infinity();
+        }
+    }
+
+#if !defined(__SSE2__) && !defined(_M_X64)
+    __attribute__((target("sse2")))
+#endif
+    unsigned span_sse2(const rst::triangle_setup& setup, const rst::triangle_attributes& attributes,
+                       int x, int y, int count, const float* depth, rst::fragment_lanes& out)
+    {
+        const __m128d inv_area = _mm_set1_pd(setup.inv_area);
+        const __m128d zero = _mm_setzero_pd();
+
+        unsigned covered = 0xFFu;
+        __m128 w[3][2];
+        for (int i = 0; i < 3; ++i)
+        {
+            __m128d start = _mm_set1_pd(setup.edge(i, x, y));
+            __m128d step = _mm_set1_pd(setup.a[i]);
+            __m128 halves[4];
+            unsigned inside = 0;
+            for (int q = 0; q < 4; ++q)
+            {
+                __m128d lane = _mm_set_pd(2 * q + 1, 2 * q);
+                __m128d e = _mm_add_pd(start, _mm_mul_pd(lane, step));
+                inside |= (unsigned)_mm_movemask_pd(_mm_cmpgt_pd(e, zero)) << (2 * q);
+                halves[q] = _mm_cvtpd_ps(_mm_mul_pd(e, inv_area));
+            }
+            covered &= inside;
+            w[i][0] = _mm_movelh_ps(halves[0], halves[1]);
+            w[i][1] = _mm_movelh_ps(halves[2], halves[3]);
+        }
+        covered &= (1u << count) - 1;
+        if (!covered)
+        {
+            return 0;
+        }
+
+        float depth_lanes[rst::span_width];
+        load_depth(depth, count, depth_lanes);
+
+        unsigned mask = 0;
+        for (int h = 0; h < 2; ++h)
+        {
+            __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w[0][h], _mm_set1_ps(attributes.z[0])),
+                                             _mm_mul_ps(w[1][h], _mm_set1_ps(attributes.z[1]))),
+                                  _mm_mul_ps(w[2][h], _mm_set1_ps(attributes.z[2])));
+            mask |= (unsigned)_mm_movemask_ps(_mm_cmplt_ps(z, _mm_loadu_ps(depth_lanes + 4 * h))) << (4 * h);
+            _mm_storeu_ps(out.alpha + 4 * h, w[0][h]);
+            _mm_storeu_ps(out.beta + 4 * h, w[1][h]);
+            _mm_storeu_ps(out.gamma + 4 * h, w[2][h]);
+            _mm_storeu_ps(out.z + 4 * h, z);
+        }
+        mask &= covered;
+        if (!mask)
+        {
+            return 0;
+        }
+
+        for (int k = 0; k < rst::attribute_count; ++k)
+        {
+            const float* a = attributes.attr[k];
+            for (int h = 0; h < 2; ++h)
+            {
+                __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[0]), w[0][h]),
+                                                 _mm_mul_ps(_mm_set1_ps(a[1]), w[1][h])),
+                                      _mm_mul_ps(_mm_set1_ps(a[2]), w[2][h]));
+                _mm_storeu_ps(out.attr[k] + 4 * h, v);
+            }
+        }
+        return mask;
+    }
+
+    __attribute__((target("avx2")))
+    unsigned span_avx2(const rst::triangle_setup& setup, const rst::triangle_attributes& attributes,
+                       int x, int y, int count, const float* depth, rst::fragment_lanes& out)
+    {
+        const __m256d inv_area = _mm256_set1_pd(setup.inv_area);
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d lanes_lo = _mm256_set_pd(3, 2, 1, 0);
+        const __m256d lanes_hi = _mm256_set_pd(7, 6, 5, 4);
+
+        unsigned covered = (1u << count) - 1;
+        __m256 w[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            __m256d start = _mm256_set1_pd(setup.edge(i, x, y));
+            __m256d step = _mm256_set1_pd(setup.a[i]);
+            __m256d lo = _mm256_add_pd(start, _mm256_mul_pd(lanes_lo, step));
+            __m256d hi = _mm256_add_pd(start, _mm256_mul_pd(lanes_hi, step));
+            covered &= (unsigned)_mm256_movemask_pd(_mm256_cmp_pd(lo, zero, _CMP_GT_OQ)) |
+                       (unsigned)_mm256_movemask_pd(_mm256_cmp_pd(hi, zero, _CMP_GT_OQ)) << 4;
+            w[i] = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_mul_pd(hi, inv_area)),
+                                   _mm256_cvtpd_ps(_mm256_mul_pd(lo, inv_area)));
+        }
+        if (!covered)
+        {
+            return 0;
+        }
+
+        float depth_lanes[rst::span_width];
+        load_depth(depth, count, depth_lanes);
+
+        __m256 z = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w[0], _mm256_set1_ps(attributes.z[0])),
+                                               _mm256_mul_ps(w[1], _mm256_set1_ps(attributes.z[1]))),
+                                 _mm256_mul_ps(w[2], _mm256_set1_ps(attributes.z[2])));
+        unsigned mask = covered & (unsigned)_mm256_movemask_ps(_mm256_cmp_ps(z, _mm256_loadu_ps(depth_lanes), _CMP_LT_OQ));
+        if (!mask)
+        {
+            return 0;
+        }
+        _mm256_storeu_ps(out.alpha, w[0]);
+        _mm256_storeu_ps(out.beta, w[1]);
+        _mm256_storeu_ps(out.gamma, w[2]);
+        _mm256_storeu_ps(out.z, z);
+
+        for (int k = 0; k < rst::attribute_count; ++k)
+        {
+            const float* a = attributes.attr[k];
+            __m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a[0]), w[0]),
+                                                   _mm256_mul_ps(_mm256_set1_ps(a[1]), w[1])),
+                                     _mm256_mul_ps(_mm256_set1_ps(a[2]), w[2]));
+            _mm256_storeu_ps(out.attr[k], v);
+        }
+        return mask;
+    }
+#endif
+}
+
+rst::simd_level rst::detect_simd_level()
+{
+#ifdef RST_HAS_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return simd_level::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return simd_level::SSE2;
+    }
+#endif
+    return simd_level::Scalar;
+}
+
+rst::span_kernel rst::get_span_kernel(simd_level level)
+{
+#ifdef RST_HAS_X86_SIMD
+    switch (level)
+    {
+        case simd_level::AVX2: return span_avx2;
+        case simd_level::SSE2: return span_sse2;
+        default: break;
+    }
+#endif
+    return span_scalar;
+}
+
+const char* rst::to_string(simd_level level)
+{
+    switch (level)
+    {
+        case simd_level::AVX2: return "avx2";
+        case simd_level::SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
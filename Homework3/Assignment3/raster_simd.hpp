@@ -0,0 +1,64 @@
+//
+// Span kernels: coverage, depth test and attribute interpolation for up to 8 pixels of a row.
+//
+
+#ifndef RASTERIZER_RASTER_SIMD_H
+#define RASTERIZER_RASTER_SIMD_H
+
+#include "triangle_setup.hpp"
+
+namespace rst
+{
+    constexpr int span_width = 8;
+
+    // Interpolated attributes, each stored as span_width SoA lanes.
+    constexpr int attr_color = 0;
+    constexpr int attr_normal = 3;
+    constexpr int attr_texcoord = 6;
+    constexpr int attr_view_pos = 8;
+    // Screen-space derivatives of the texture coordinates, for mip selection. Attributes are affine
+    // in screen space, so these are constant over a triangle: all three vertices carry the same value.
+    constexpr int attr_texcoord_dx = 11;
+    constexpr int attr_texcoord_dy = 13;
+    constexpr int attribute_count = 15;
+
+    // Per-vertex values of one triangle, laid out per attribute so a kernel can broadcast them.
+    struct triangle_attributes
+    {
+        float z[3];
+        float attr[attribute_count][3];
+    };
+
+    struct fragment_lanes
+    {
+        float alpha[span_width];
+        float beta[span_width];
+        float gamma[span_width];
+        float z[span_width];
+        float attr[attribute_count][span_width];
+    };
+
+    enum class simd_level
+    {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    // Tests pixels (x .. x + count - 1, y) against the triangle and against depth[0 .. count - 1].
+    // Returns a bit mask of the lanes that are covered and pass the depth test; for those lanes
+    // out holds the barycentrics, depth and interpolated attributes. All kernels produce
+    // bit-identical results: edge values are exact, and the float math runs in the same order.
+    using span_kernel = unsigned (*)(const triangle_setup& setup, const triangle_attributes& attributes,
+                                     int x, int y, int count, const float* depth, fragment_lanes& out);
+
+    // Best level supported by the running CPU.
+    simd_level detect_simd_level();
+
+    // Kernel for the given level, falling back to a lower one when it was not compiled in.
+    span_kernel get_span_kernel(simd_level level);
+
+    const char* to_string(simd_level level);
+}
+
+#endif //RASTERIZER_RASTER_SIMD_H
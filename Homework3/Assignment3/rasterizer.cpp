@@ -4,6 +4,8 @@
 
 #include <algorithm>
 #include "rasterizer.hpp"
+#include "triangle_setup.hpp"
+#include "shaders.hpp"
 #include <opencv2/opencv.hpp>
 #include <math.h>
 
@@ -42,6 +44,44 @@ rst::col_buf_id rst::rasterizer::load_normals(const std::vector<Eigen::Vector3f>
     return {id};
 }
 
+rst::col_buf_id rst::rasterizer::load_texcoords(const std::vector<Eigen::Vector2f>& tex_coords)
+{
+    auto id = get_next_id();
+    tex_buf.emplace(id, tex_coords);
+
+    texcoord_id = id;
+
+    return {id};
+}
+
+// Clamps, rounds and swizzles in the write itself, with the rounding and saturation of
+// cv::Mat::convertTo to CV_8U, so no conversion pass is needed before display.
+void rst::rasterizer::store_pixel(int index, const Eigen::Vector3f& color)
+{
+    switch (format)
+    {
+        case Format::BGRA8:
+        {
+            uint8_t* p = &bgra_buf[4 * index];
+            for (int c = 0; c < 3; ++c)
+            {
+                p[2 - c] = cv::saturate_cast<uint8_t>(color[c]);
+            }
+            p[3] = 255;
+            break;
+        }
+        case Format::PlanarFloat:
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                planar_buf[c * width * height + index] = color[c];
+            }
+            break;
+        }
+        default:
+            frame_buf[index] = color;
+    }
+}
 
 // Bresenham's line drawing algorithm
 void rst::rasterizer::draw_line(Eigen::Vector3f begin, Eigen::Vector3f end)
@@ -149,94 +189,357 @@ auto to_vec4(const Eigen::Vector3f& v3, float w = 1.0f)
     return Vector4f(v3.x(), v3.y(), v3.z(), w);
 }
 
-static bool insideTriangle(int x, int y, const Vector4f* _v){
-    Vector3f v[3];
-    for(int i=0;i<3;i++)
-        v[i] = {_v[i].x(),_v[i].y(), 1.0};
-    Vector3f f0,f1,f2;
-    f0 = v[1].cross(v[0]);
-    f1 = v[2].cross(v[1]);
-    f2 = v[0].cross(v[2]);
-    Vector3f p(x,y,1.);
-    if((p.dot(f0)*f0.dot(v[2])>0) && (p.dot(f1)*f1.dot(v[0])>0) && (p.dot(f2)*f2.dot(v[1])>0))
-        return true;
-    return false;
+rst::rasterizer::vertex_transform rst::rasterizer::begin_draw()
+{
+    view_uniforms = uniforms;
+    for (int i = 0; i < uniforms.light_count; ++i)
+    {
+        view_uniforms.lights[i].position = (view * to_vec4(uniforms.lights[i].position)).head<3>();
+    }
+    view_uniforms.eye_pos = (view * to_vec4(uniforms.eye_pos)).head<3>();
+
+    vertex_transform xf;
+    xf.model_view = view * model;
+    xf.mvp = projection * xf.model_view;
+    xf.normal_matrix = xf.model_view.inverse().transpose().topLeftCorner<3, 3>();
+    // Camera looks down -z in view space; w_sign flips clip coordinates so w > 0 in front of it.
+    xf.w_sign = projection(3, 2) > 0 ? -1.f : 1.f;
+    xf.space = {z_near, z_far, 1 + 2 * guard_band_px / width, 1 + 2 * guard_band_px / height};
+    return xf;
 }
 
-static std::tuple<float, float, float> computeBarycentric2D(float x, float y, const Vector4f* v){
-    float c1 = (x*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*y + v[1].x()*v[2].y() - v[2].x()*v[1].y()) / (v[0].x()*(v[1].y() - v[2].y()) + (v[2].x() - v[1].x())*v[0].y() + v[1].x()*v[2].y() - v[2].x()*v[1].y());
-    float c2 = (x*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*y + v[2].x()*v[0].y() - v[0].x()*v[2].y()) / (v[1].x()*(v[2].y() - v[0].y()) + (v[0].x() - v[2].x())*v[1].y() + v[2].x()*v[0].y() - v[0].x()*v[2].y());
-    float c3 = (x*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*y + v[0].x()*v[1].y() - v[1].x()*v[0].y()) / (v[2].x()*(v[0].y() - v[1].y()) + (v[1].x() - v[0].x())*v[2].y() + v[0].x()*v[1].y() - v[1].x()*v[0].y());
-    return {c1,c2,c3};
+rst::rasterizer::cached_vertex rst::rasterizer::transform_vertex(const vertex_transform& xf, const Eigen::Vector4f& position, const Eigen::Vector3f& normal,
+                                                                 const Eigen::Vector2f& tex_coords, const Eigen::Vector3f& color) const
+{
+    cached_vertex out;
+    out.vertex.clip = xf.mvp * position * xf.w_sign;
+    out.vertex.view_pos = (xf.model_view * position).head<3>();
+    out.vertex.normal = xf.normal_matrix * normal;
+    out.vertex.tex_coords = tex_coords;
+    out.vertex.color = color;
+    out.outcode = xf.space.outcode(out.vertex.clip);
+    return out;
 }
 
-void rst::rasterizer::draw(std::vector<Triangle *> &TriangleList) {
+void rst::rasterizer::transform_vertices(const vertex_transform& xf, size_t count, const Eigen::Vector3f* positions, const Eigen::Vector3f* normals,
+                                         const Eigen::Vector2f* tex_coords, const Eigen::Vector3f* colors, float color_scale)
+{
+    vertex_cache.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        vertex_cache[i] = transform_vertex(xf, to_vec4(positions[i]),
+                                           normals ? normals[i] : Eigen::Vector3f::Zero(),
+                                           tex_coords ? tex_coords[i] : Eigen::Vector2f::Zero(),
+                                           colors ? Eigen::Vector3f(colors[i] * color_scale) : Eigen::Vector3f::Zero());
+    }
+}
 
-    float f1 = (50 - 0.1) / 2.0;
-    float f2 = (50 + 0.1) / 2.0;
+void rst::rasterizer::assemble_triangle(const vertex_transform& xf, int i0, int i1, int i2)
+{
+    const cached_vertex* corners[3] = {&vertex_cache[i0], &vertex_cache[i1], &vertex_cache[i2]};
+    int outcodes[3] = {corners[0]->outcode, corners[1]->outcode, corners[2]->outcode};
 
-    Eigen::Matrix4f mvp = projection * view * model;
-    for (const auto& t:TriangleList)
+    // Reject triangles entirely outside one plane of the view frustum
+    if (outcodes[0] & outcodes[1] & outcodes[2] & frustum_planes)
     {
-        Triangle newtri = *t;
+        frame_counters.triangles_frustum_culled++;
+        return;
+    }
 
-        std::array<Eigen::Vector4f, 3> mm {
-                (view * model * t->v[0]),
-                (view * model * t->v[1]),
-                (view * model * t->v[2])
-        };
+    std::array<clip_vertex, 9> poly;
+    for (int i = 0; i < 3; ++i)
+    {
+        poly[i] = corners[i]->vertex;
+    }
 
-        std::array<Eigen::Vector3f, 3> viewspace_pos;
+    // Clip against the near plane, and against the guard band only when it is exceeded
+    int count = 3;
+    int clip_mask = (outcodes[0] | outcodes[1] | outcodes[2]) & clipped_planes;
+    if (clip_mask)
+    {
+        frame_counters.triangles_clipped++;
+        count = clip_polygon(poly, count, clip_mask, xf.space);
+        if (count < 3)
+        {
+            return;
+        }
+    }
+
+    //Homogeneous division + Viewport transformation
+    float f1 = (z_far - z_near) / 2.0;
+    float f2 = (z_far + z_near) / 2.0;
+    std::array<Eigen::Vector4f, 9> v;
+    for (int i = 0; i < count; ++i)
+    {
+        const auto& c = poly[i].clip;
+        v[i] = Eigen::Vector4f(0.5 * width * (c.x() / c.w() + 1.0), 0.5 * height * (c.y() / c.w() + 1.0),
+                               c.z() / c.w() * f1 + f2, c.w());
+    }
 
-        std::transform(mm.begin(), mm.end(), viewspace_pos.begin(), [](auto& v) {
-            return v.template head<3>();
-        });
-
-        Eigen::Vector4f v[] = {
-                mvp * t->v[0],
-                mvp * t->v[1],
-                mvp * t->v[2]
-        };
-        //Homogeneous division
-        for (auto& vec : v) {
-            vec.x()/=vec.w();
-            vec.y()/=vec.w();
-            vec.z()/=vec.w();
-        }
-
-        Eigen::Matrix4f inv_trans = (view * model).inverse().transpose();
-        Eigen::Vector4f n[] = {
-                inv_trans * to_vec4(t->normal[0], 0.0f),
-                inv_trans * to_vec4(t->normal[1], 0.0f),
-                inv_trans * to_vec4(t->normal[2], 0.0f)
-        };
-
-        //Viewport transformation
-        for (auto & vert : v)
+    if (cull_mode != Cull::None)
+    {
+        // Winding of the (convex, planar) polygon; the viewport transform keeps its sign.
+        float area = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            const auto& a = v[i];
+            const auto& b = v[(i + 1) % count];
+            area += a.x() * b.y() - b.x() * a.y();
+        }
+        bool front = area > 0;
+        if (cull_mode == Cull::Back ? !front : front)
         {
-            vert.x() = 0.5*width*(vert.x()+1.0);
-            vert.y() = 0.5*height*(vert.y()+1.0);
-            vert.z() = vert.z() * f1 + f2;
+            frame_counters.triangles_face_culled++;
+            return;
         }
+    }
 
-        for (int i = 0; i < 3; ++i)
+    // Fan-triangulate the clipped polygon
+    for (int i = 1; i + 1 < count; ++i)
+    {
+        Triangle newtri;
+        int fan[3] = {0, i, i + 1};
+        std::array<Eigen::Vector3f, 3> viewspace_pos;
+        for (int j = 0; j < 3; ++j)
         {
+            const auto& vertex = poly[fan[j]];
             //screen space coordinates
-            newtri.setVertex(i, v[i]);
+            newtri.setVertex(j, v[fan[j]]);
+            //view space normal
+            newtri.setNormal(j, vertex.normal);
+            newtri.setTexCoord(j, vertex.tex_coords);
+            newtri.color[j] = vertex.color;
+            viewspace_pos[j] = vertex.view_pos;
+        }
+
+        primitives.push_back(newtri);
+        primitive_view_pos.push_back(viewspace_pos);
+    }
+}
+
+void rst::rasterizer::draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type)
+{
+    if (type != rst::Primitive::Triangle)
+    {
+        throw std::runtime_error("Drawing primitives other than triangle is not implemented yet!");
+    }
+
+    const auto& positions = pos_buf[pos_buffer.pos_id];
+    const auto& indices = ind_buf[ind_buffer.ind_id];
+    const auto& colors = col_buf[col_buffer.col_id];
+    const auto* normals = normal_id >= 0 ? &nor_buf[normal_id] : nullptr;
+    const auto* tex_coords = texcoord_id >= 0 ? &tex_buf[texcoord_id] : nullptr;
+
+    // Vertex stage: each vertex once, however many triangles share it
+    vertex_transform xf = begin_draw();
+    transform_vertices(xf, positions.size(), positions.data(), normals ? normals->data() : nullptr,
+                       tex_coords ? tex_coords->data() : nullptr, colors.size() == positions.size() ? colors.data() : nullptr,
+                       1.f / 255.f);
+
+    // Primitive assembly reads the cache
+    frame_counters.triangles_submitted += indices.size();
+    primitives.clear();
+    primitive_view_pos.clear();
+    for (const auto& i : indices)
+    {
+        assemble_triangle(xf, i[0], i[1], i[2]);
+    }
+
+    rasterize_primitives(fragment_shader);
+}
+
+void rst::rasterizer::draw(const MeshView& mesh)
+{
+    assemble_mesh(mesh);
+    rasterize_primitives(fragment_shader);
+}
+
+template<typename Shader>
+void rst::rasterizer::draw(const MeshView& mesh, const Shader& shader)
+{
+    assemble_mesh(mesh);
+    rasterize_primitives(shader);
+}
+
+int rst::rasterizer::select_lod(const lod_chain& lods, float pixel_error) const
+{
+    Eigen::Matrix4f model_view = view * model;
+    Eigen::Vector4f center = model_view * lods.center().homogeneous();
+    float scale = model_view.topLeftCorner<3, 3>().colwise().norm().maxCoeff();
+    float radius = lods.radius() * scale;
+    if (radius <= 0 || std::abs(center.z()) <= radius)
+    {
+        return 0;
+    }
+
+    // Pixels per view space unit at the sphere's distance, from the projected height of its radius
+    Eigen::Vector4f a = projection * center;
+    Eigen::Vector4f b = projection * (center + Eigen::Vector4f(0, radius, 0, 0));
+    float pixels_per_unit = std::abs(b.y() / b.w() - a.y() / a.w()) * 0.5f * height / radius;
+
+    int level = 0;
+    while (level + 1 < lods.size() && lods.error(level + 1) * scale * pixels_per_unit <= pixel_error)
+    {
+        level++;
+    }
+    return level;
+}
+
+rst::Visibility rst::rasterizer::box_visibility(const Eigen::AlignedBox3f& box) const
+{
+    Eigen::Matrix4f view_projection = projection * view * (projection(3, 2) > 0 ? -1.f : 1.f);
+    clip_space space = {z_near, z_far, 1, 1};
+    int all = frustum_planes;
+    int any = 0;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        Eigen::Vector3f p = box.corner(Eigen::AlignedBox3f::CornerType(corner));
+        int outcode = space.outcode(view_projection * p.homogeneous()) & frustum_planes;
+        all &= outcode;
+        any |= outcode;
+    }
+    return all ? Visibility::Outside : any ? Visibility::Partial : Visibility::Inside;
+}
+
+void rst::rasterizer::assemble_mesh(const MeshView& mesh)
+{
+    vertex_transform xf = begin_draw();
+    transform_vertices(xf, mesh.vertex_count, mesh.positions, mesh.normals, mesh.tex_coords, mesh.colors, 1.f);
+
+    frame_counters.triangles_submitted += mesh.triangle_count();
+    primitives.clear();
+    primitive_view_pos.clear();
+    for (size_t i = 0; i + 2 < mesh.index_count; i += 3)
+    {
+        assemble_triangle(xf, mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2]);
+    }
+}
+
+void rst::rasterizer::draw(std::vector<Triangle *> &TriangleList) {
+
+    // Triangles carry their own vertices, so the cache holds three entries per triangle; only the
+    // per-draw matrices are shared.
+    vertex_transform xf = begin_draw();
+    vertex_cache.resize(TriangleList.size() * 3);
+    for (size_t i = 0; i < TriangleList.size(); ++i)
+    {
+        const Triangle* t = TriangleList[i];
+        for (int j = 0; j < 3; ++j)
+        {
+            vertex_cache[3 * i + j] = transform_vertex(xf, t->v[j], t->normal[j], t->tex_coords[j],
+                                                       Eigen::Vector3f(148 / 255., 121 / 255., 92 / 255.));
         }
+    }
+
+    frame_counters.triangles_submitted += TriangleList.size();
+    primitives.clear();
+    primitive_view_pos.clear();
+    for (size_t i = 0; i < TriangleList.size(); ++i)
+    {
+        assemble_triangle(xf, 3 * i, 3 * i + 1, 3 * i + 2);
+    }
+
+    rasterize_primitives(fragment_shader);
+}
 
-        for (int i = 0; i < 3; ++i)
+template<typename Shader>
+void rst::rasterizer::rasterize_primitives(const Shader& shader)
+{
+    // Deferred: only the pixels this draw's triangles may cover are cleared and resolved, so the
+    // cost of a draw follows its screen size rather than the frame's. The columns are widened to
+    // whole spans, as the resolve shades a span at a time.
+    rect covered{width, height, 0, 0};
+    if (shading == Shading::Deferred)
+    {
+        for (const Triangle& t : primitives)
         {
-            //view space normal
-            newtri.setNormal(i, n[i].head<3>());
+            Eigen::Vector2f bounding_box_x;
+            Eigen::Vector2f bounding_box_y;
+            get_bounding_box(t, &bounding_box_x, &bounding_box_y);
+            covered.x0 = std::min<int>(covered.x0, std::floor(bounding_box_x[1]));
+            covered.x1 = std::max<int>(covered.x1, std::ceil(bounding_box_x[0]));
+            covered.y0 = std::min<int>(covered.y0, std::floor(bounding_box_y[1]));
+            covered.y1 = std::max<int>(covered.y1, std::ceil(bounding_box_y[0]));
+        }
+        covered.x0 = std::max(covered.x0, scissor.x0) / span_width * span_width;
+        covered.x1 = std::min(width, (std::min(covered.x1, scissor.x1) + span_width - 1) / span_width * span_width);
+        covered.y0 = std::max(covered.y0, scissor.y0);
+        covered.y1 = std::min(covered.y1, scissor.y1);
+        for (int y = covered.y0; y < covered.y1; ++y)
+        {
+            int index = get_index(0, y);
+            std::fill(visibility_buf.begin() + index + covered.x0, visibility_buf.begin() + index + std::max(covered.x0, covered.x1),
+                      visibility_sample{-1, 0, 0, 0});
+        }
+    }
+
+    if (thread_count > 1)
+    {
+        draw_tiled(primitives, primitive_view_pos, shader);
+    }
+    else
+    {
+        for (size_t i = 0; i < primitives.size(); ++i)
+        {
+            // Also pass view space vertice position
+            rasterize_triangle(primitives[i], primitive_view_pos[i], i, scissor, frame_counters, shader);
+        }
+    }
+
+    if (shading == Shading::Deferred)
+    {
+        resolve_visibility(primitives, primitive_view_pos, covered, shader);
+    }
+}
+
+// Sort-middle rasterization: every triangle is appended to the bins of the tiles its bounding box
+// overlaps, in submission order. Each tile is then owned by exactly one thread, which walks its bin
+// front to back, so every pixel sees the same triangle order (and result) as the serial path.
+template<typename Shader>
+void rst::rasterizer::draw_tiled(const std::vector<Triangle>& triangles, const std::vector<std::array<Eigen::Vector3f, 3>>& view_positions, const Shader& shader)
+{
+    int tiles_x = (width + tile_size - 1) / tile_size;
+    int tiles_y = (height + tile_size - 1) / tile_size;
+    std::vector<std::vector<int>> bins(tiles_x * tiles_y);
+
+    for (int i = 0; i < (int)triangles.size(); ++i)
+    {
+        Eigen::Vector2f bounding_box_x;
+        Eigen::Vector2f bounding_box_y;
+        get_bounding_box(triangles[i], &bounding_box_x, &bounding_box_y);
+
+        int x_min = std::max<int>(scissor.x0, std::floor(bounding_box_x[1]));
+        int x_max = std::min<int>(scissor.x1, std::ceil(bounding_box_x[0])) - 1;
+        int y_min = std::max<int>(scissor.y0, std::floor(bounding_box_y[1]));
+        int y_max = std::min<int>(scissor.y1, std::ceil(bounding_box_y[0])) - 1;
+        if (x_min > x_max || y_min > y_max)
+        {
+            continue;
         }
 
-        newtri.setColor(0, 148,121.0,92.0);
-        newtri.setColor(1, 148,121.0,92.0);
-        newtri.setColor(2, 148,121.0,92.0);
+        for (int ty = y_min / tile_size; ty <= y_max / tile_size; ++ty)
+        {
+            for (int tx = x_min / tile_size; tx <= x_max / tile_size; ++tx)
+            {
+                bins[ty * tiles_x + tx].push_back(i);
+            }
+        }
+    }
 
-        // Also pass view space vertice position
-        rasterize_triangle(newtri, viewspace_pos);
+    std::vector<frame_stats> tile_stats(tiles_x * tiles_y);
+    pool->parallel_for(tiles_x * tiles_y, [&](int tile) {
+        int tx = tile % tiles_x;
+        int ty = tile / tiles_x;
+        rect clip{std::max(scissor.x0, tx * tile_size), std::max(scissor.y0, ty * tile_size),
+                  std::min(scissor.x1, (tx + 1) * tile_size), std::min(scissor.y1, (ty + 1) * tile_size)};
+        for (int i : bins[tile])
+        {
+            rasterize_triangle(triangles[i], view_positions[i], i, clip, tile_stats[tile], shader);
+        }
+    });
+    for (auto& s : tile_stats)
+    {
+        frame_counters += s;
     }
 }
 
@@ -256,8 +559,45 @@ static Eigen::Vector2f interpolate(float alpha, float beta, float gamma, const E
     return Eigen::Vector2f(u, v);
 }
 
+static rst::triangle_attributes make_attributes(const Triangle& t, const std::array<Eigen::Vector3f, 3>& view_pos)
+{
+    rst::triangle_attributes attributes;
+    for (int i = 0; i < 3; ++i)
+    {
+        attributes.z[i] = t.v[i].z();
+        for (int k = 0; k < 3; ++k)
+        {
+            attributes.attr[rst::attr_color + k][i] = t.color[i][k];
+            attributes.attr[rst::attr_normal + k][i] = t.normal[i][k];
+            attributes.attr[rst::attr_view_pos + k][i] = view_pos[i][k];
+        }
+        attributes.attr[rst::attr_texcoord][i] = t.tex_coords[i].x();
+        attributes.attr[rst::attr_texcoord + 1][i] = t.tex_coords[i].y();
+    }
+
+    // Gradient of the (affine) texture coordinates over the screen-space triangle
+    Eigen::Vector2f e1 = (t.v[1] - t.v[0]).head<2>(), e2 = (t.v[2] - t.v[0]).head<2>();
+    Eigen::Vector2f d1 = t.tex_coords[1] - t.tex_coords[0], d2 = t.tex_coords[2] - t.tex_coords[0];
+    float det = e1.x() * e2.y() - e2.x() * e1.y();
+    Eigen::Vector2f duv_dx = Eigen::Vector2f::Zero(), duv_dy = Eigen::Vector2f::Zero();
+    if (det != 0)
+    {
+        duv_dx = (d1 * e2.y() - d2 * e1.y()) / det;
+        duv_dy = (d2 * e1.x() - d1 * e2.x()) / det;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int k = 0; k < 2; ++k)
+        {
+            attributes.attr[rst::attr_texcoord_dx + k][i] = duv_dx[k];
+            attributes.attr[rst::attr_texcoord_dy + k][i] = duv_dy[k];
+        }
+    }
+    return attributes;
+}
+
 void rst::rasterizer::get_bounding_box(const Triangle &t, Eigen::Vector2f *bounding_box_x, Eigen::Vector2f *bounding_box_y){
-    float bounding_box_min = std::numeric_limits<float>::min();
+    float bounding_box_min = std::numeric_limits<float>::lowest();
     float bounding_box_max = std::numeric_limits<float>::max();
 
     // 初始化 bounding_box 的范围，初始化是无限
@@ -285,7 +625,8 @@ void rst::rasterizer::get_bounding_box(const Triangle &t, Eigen::Vector2f *bound
 }
 
 //Screen space rasterization
-void rst::rasterizer::rasterize_triangle(const Triangle& t, const std::array<Eigen::Vector3f, 3>& view_pos) 
+template<typename Shader>
+void rst::rasterizer::rasterize_triangle(const Triangle& t, const std::array<Eigen::Vector3f, 3>& view_pos, int id, const rect& clip, frame_stats& stats, const Shader& shader)
 {
     // TODO: From your HW3, get the triangle rasterization code.
     // TODO: Inside your rasterization loop:
@@ -303,43 +644,298 @@ void rst::rasterizer::rasterize_triangle(const Triangle& t, const std::array<Eig
     // auto interpolated_texcoords
     // auto interpolated_shadingcoords
 
-    // Use: fragment_shader_payload payload( interpolated_color, interpolated_normal.normalized(), interpolated_texcoords, texture ? &*texture : nullptr);
+    // Use: fragment_shader_payload payload( interpolated_color, interpolated_normal.normalized(), interpolated_texcoords, bound_texture);
     // Use: payload.view_pos = interpolated_shadingcoords;
     // Use: Instead of passing the triangle's color directly to the frame buffer, pass the color to the shaders first to get the final color;
     // Use: auto pixel_color = fragment_shader(payload);
 
-    auto v = t.toVector4();
     Eigen::Vector2f bounding_box_x;
     Eigen::Vector2f bounding_box_y;
     get_bounding_box(t, &bounding_box_x, &bounding_box_y);
-    for(int x = std::floor(bounding_box_x[1]); x < std::ceil(bounding_box_x[0]); x++){
-      for(int y = std::floor(bounding_box_y[1]); y < std::ceil(bounding_box_y[0]); y++){
-          bool res = insideTriangle(x, y, t.v);
-          if(res){
-                  auto[alpha, beta, gamma] = computeBarycentric2D(x, y, t.v);
-                  float w_reciprocal = 1.0/(alpha / v[0].w() + beta / v[1].w() + gamma / v[2].w());
-                  float z_interpolated = alpha * v[0].z() / v[0].w() + beta * v[1].z() / v[1].w() + gamma * v[2].z() / v[2].w();
-                  z_interpolated *= w_reciprocal;
-                  if(z_interpolated < depth_buf[get_index(x, y)]){
-                      Eigen::Vector2i point(x, y);
-
-                       auto interpolated_color = t.color[0]*alpha + t.color[1]*beta + t.color[2]*gamma;
-                      auto interpolated_normal = t.normal[0] * alpha + t.normal[1]* beta + t.normal[2]* gamma;
-                      auto interpolated_texcoords = t.tex_coords[0] * alpha + t.tex_coords[1] * beta + t.tex_coords[2]* gamma;
-                      auto interpolated_shadingcoords = view_pos[0] * alpha + view_pos[1] * beta + view_pos[2] * gamma;
-
-                      fragment_shader_payload payload( interpolated_color, interpolated_normal.normalized(), interpolated_texcoords, texture ? &*texture : nullptr);
-                      payload.view_pos = interpolated_shadingcoords;
-                      
-                      auto pixel_color = fragment_shader(payload);
-                      set_pixel(point, pixel_color);
-                      depth_buf[get_index(x, y)] = z_interpolated;
+    int x_begin = std::max<int>(clip.x0, std::floor(bounding_box_x[1]));
+    int x_end = std::min<int>(clip.x1, std::ceil(bounding_box_x[0]));
+    int y_begin = std::max<int>(clip.y0, std::floor(bounding_box_y[1]));
+    int y_end = std::min<int>(clip.y1, std::ceil(bounding_box_y[0]));
+    if (x_begin >= x_end || y_begin >= y_end)
+    {
+        return;
+    }
+
+    triangle_setup setup;
+    if (!setup_triangle(t.v, setup))
+    {
+        return;
+    }
+
+    // toVector4() resets w to 1, so depth and attributes are interpolated linearly in screen space.
+    triangle_attributes attributes = make_attributes(t, view_pos);
+
+    // Depth is affine in screen space: z(x, y) = z_dx * x + z_dy * y + z_c. Its minimum over a block
+    // is at one of the block corners, and never below the nearest vertex. The margin keeps the bound
+    // conservative against the float rounding of the per-pixel depth.
+    double z_dx = 0, z_dy = 0, z_c = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        z_dx += attributes.z[i] * setup.a[i] * setup.inv_area;
+        z_dy += attributes.z[i] * setup.b[i] * setup.inv_area;
+        z_c += attributes.z[i] * setup.c[i] * setup.inv_area;
+    }
+    float z_near = std::min({attributes.z[0], attributes.z[1], attributes.z[2]});
+
+    fragment_lanes lanes;
+    for(int by = y_begin / hiz_block; by * hiz_block < y_end; by++){
+      for(int bx = x_begin / hiz_block; bx * hiz_block < x_end; bx++){
+          int x0 = std::max(x_begin, bx * hiz_block), x1 = std::min(x_end, (bx + 1) * hiz_block);
+          int y0 = std::max(y_begin, by * hiz_block), y1 = std::min(y_end, (by + 1) * hiz_block);
+
+          // Skip blocks that lie entirely outside one of the edges.
+          bool outside = false;
+          for (int i = 0; i < 3 && !outside; ++i)
+          {
+              outside = setup.edge(i, setup.a[i] > 0 ? x1 - 1 : x0, setup.b[i] > 0 ? y1 - 1 : y0) <= 0;
+          }
+          if (outside)
+          {
+              continue;
+          }
+
+          stats.hiz_blocks_tested++;
+          double block_near = z_c + std::min(z_dx * x0, z_dx * (x1 - 1)) + std::min(z_dy * y0, z_dy * (y1 - 1));
+          float z_min = std::max<double>(z_near, block_near);
+          z_min -= 1e-5f * (1.f + std::abs(z_min));
+          if (z_min >= hiz_buf[by * hiz_width + bx])
+          {
+              stats.hiz_blocks_culled++;
+              stats.hiz_pixels_culled += (x1 - x0) * (y1 - y0);
+              continue;
+          }
+
+          if (block_clears[by * hiz_width + bx])
+          {
+              materialize_block(by * hiz_width + bx, block_clears[by * hiz_width + bx]);
+          }
+
+          bool written = false;
+          for(int y = y0; y < y1; y++){
+              int index = get_index(x0, y);
+              unsigned mask = span(setup, attributes, x0, y, x1 - x0, &depth_buf[index], lanes);
+              written = written || mask;
+              for (unsigned m = mask; m; m &= m - 1)
+              {
+                  int lane = __builtin_ctz(m);
+                  depth_buf[index + lane] = lanes.z[lane];
+                  if (shading == Shading::Deferred)
+                  {
+                      visibility_buf[index + lane] = {id, lanes.alpha[lane], lanes.beta[lane], lanes.gamma[lane]};
                   }
+              }
+              if (mask && shading == Shading::Forward)
+              {
+                  shade_span(shader, lanes, mask, index);
+                  stats.fragments_shaded += __builtin_popcount(mask);
+              }
+          }
+          if (written)
+          {
+              update_hiz(bx, by);
           }
       }
     }
 }
 
+// Second pass of the deferred mode: every pixel of area the draw left in the visibility buffer is
+// shaded exactly once, with attributes interpolated the same way the span kernels do.
+template<typename Shader>
+void rst::rasterizer::resolve_visibility(const std::vector<Triangle>& triangles, const std::vector<std::array<Eigen::Vector3f, 3>>& view_positions, const rect& area, const Shader& shader)
+{
+    const int rows_per_task = 16;
+    int tasks = std::max(0, (area.y1 - area.y0 + rows_per_task - 1) / rows_per_task);
+    std::vector<long> shaded(tasks, 0);
+
+    auto resolve_rows = [&](int task) {
+        int last = -1;
+        triangle_attributes attributes;
+        fragment_lanes lanes;
+        for (int y = area.y0 + task * rows_per_task; y < std::min(area.y1, area.y0 + (task + 1) * rows_per_task); ++y)
+        {
+            int index = get_index(0, y);
+            for (int x0 = area.x0; x0 < area.x1; x0 += span_width)
+            {
+                unsigned mask = 0;
+                for (int lane = 0; lane < std::min(span_width, area.x1 - x0); ++lane)
+                {
+                    const auto& sample = visibility_buf[index + x0 + lane];
+                    if (sample.triangle < 0)
+                    {
+                        continue;
+                    }
+                    if (sample.triangle != last)
+                    {
+                        last = sample.triangle;
+                        attributes = make_attributes(triangles[last], view_positions[last]);
+                    }
+
+                    for (int k = 0; k < attribute_count; ++k)
+                    {
+                        const float* a = attributes.attr[k];
+                        lanes.attr[k][lane] = a[0] * sample.alpha + a[1] * sample.beta + a[2] * sample.gamma;
+                    }
+                    mask |= 1u << lane;
+                }
+                if (mask)
+                {
+                    shade_span(shader, lanes, mask, index + x0);
+                    shaded[task] += __builtin_popcount(mask);
+                }
+            }
+        }
+    };
+
+    if (thread_count > 1)
+    {
+        pool->parallel_for(tasks, resolve_rows);
+    }
+    else
+    {
+        for (int task = 0; task < tasks; ++task)
+        {
+            resolve_rows(task);
+        }
+    }
+
+    for (long count : shaded)
+    {
+        frame_counters.fragments_shaded += count;
+    }
+}
+
+template<typename Shader>
+Eigen::Vector3f rst::rasterizer::shade_fragment(const Shader& shader, const float* values)
+{
+    Eigen::Vector3f interpolated_color(values[attr_color], values[attr_color + 1], values[attr_color + 2]);
+    Eigen::Vector3f interpolated_normal(values[attr_normal], values[attr_normal + 1], values[attr_normal + 2]);
+    Eigen::Vector2f interpolated_texcoords(values[attr_texcoord], values[attr_texcoord + 1]);
+    Eigen::Vector3f interpolated_shadingcoords(values[attr_view_pos], values[attr_view_pos + 1], values[attr_view_pos + 2]);
+
+    fragment_shader_payload payload( interpolated_color, interpolated_normal.normalized(), interpolated_texcoords, bound_texture);
+    payload.view_pos = interpolated_shadingcoords;
+    payload.tex_coords_dx = Eigen::Vector2f(values[attr_texcoord_dx], values[attr_texcoord_dx + 1]);
+    payload.tex_coords_dy = Eigen::Vector2f(values[attr_texcoord_dy], values[attr_texcoord_dy + 1]);
+    payload.uniforms = &view_uniforms;
+
+    return shader(payload);
+}
+
+template<typename Shader>
+void rst::rasterizer::shade_span(const Shader& shader, const fragment_lanes& lanes, unsigned mask, int index)
+{
+    static_assert(packet_width == span_width, "a packet holds one span");
+    if constexpr (is_packet_shader<Shader>::value)
+    {
+        fragment_packet packet{mask, &lanes.attr[attr_color], &lanes.attr[attr_normal], &lanes.attr[attr_texcoord],
+                               &lanes.attr[attr_texcoord_dx], &lanes.attr[attr_texcoord_dy], &lanes.attr[attr_view_pos],
+                               bound_texture, &view_uniforms};
+        color_packet colors;
+        shader(packet, colors);
+        for (; mask; mask &= mask - 1)
+        {
+            int lane = __builtin_ctz(mask);
+            store_pixel(index + lane, Eigen::Vector3f(colors.rgb[0][lane], colors.rgb[1][lane], colors.rgb[2][lane]));
+        }
+    }
+    else
+    {
+        for (; mask; mask &= mask - 1)
+        {
+            int lane = __builtin_ctz(mask);
+            float values[attribute_count];
+            for (int k = 0; k < attribute_count; ++k)
+            {
+                values[k] = lanes.attr[k][lane];
+            }
+            store_pixel(index + lane, shade_fragment(shader, values));
+        }
+    }
+}
+
+// Fills the given buffers (bits of Buffers) of one hiz block with their clear values and unmarks them.
+void rst::rasterizer::materialize_block(int block, int buffers)
+{
+    block_clears[block] &= ~buffers;
+    int x0 = block % hiz_width * hiz_block, x1 = std::min(width, x0 + hiz_block);
+    int y0 = block / hiz_width * hiz_block, y1 = std::min(height, y0 + hiz_block);
+    uint8_t bgra[4];
+    for (int c = 0; c < 3; ++c)
+    {
+        bgra[2 - c] = cv::saturate_cast<uint8_t>(color_clear_value[c]);
+    }
+    bgra[3] = 255;
+
+    for (int y = y0; y < y1; ++y)
+    {
+        int index = get_index(x0, y);
+        if (buffers & (int)Buffers::Depth)
+        {
+            std::fill_n(&depth_buf[index], x1 - x0, std::numeric_limits<float>::infinity());
+        }
+        if (!(buffers & (int)Buffers::Color))
+        {
+            continue;
+        }
+        switch (format)
+        {
+            case Format::BGRA8:
+                for (int x = 0; x < x1 - x0; ++x)
+                {
+                    std::copy_n(bgra, 4, &bgra_buf[4 * (index + x)]);
+                }
+                break;
+            case Format::PlanarFloat:
+                for (int c = 0; c < 3; ++c)
+                {
+                    std::fill_n(&planar_buf[c * width * height + index], x1 - x0, color_clear_value[c]);
+                }
+                break;
+            default:
+                std::fill_n(&frame_buf[index], x1 - x0, color_clear_value);
+        }
+    }
+}
+
+// Fills the color of the blocks no draw reached since the last clear, before the frame is read.
+void rst::rasterizer::resolve_clears()
+{
+    if (!color_clears_pending)
+    {
+        return;
+    }
+    for (int block = 0; block < (int)block_clears.size(); ++block)
+    {
+        if (block_clears[block] & (int)Buffers::Color)
+        {
+            materialize_block(block, (int)Buffers::Color);
+        }
+    }
+    color_clears_pending = false;
+}
+
+// Recomputes the farthest depth of one coarse block after pixels in it were written.
+void rst::rasterizer::update_hiz(int block_x, int block_y)
+{
+    int x0 = block_x * hiz_block, x1 = std::min(width, x0 + hiz_block);
+    int y0 = block_y * hiz_block, y1 = std::min(height, y0 + hiz_block);
+    float z_far = -std::numeric_limits<float>::infinity();
+    for (int y = y0; y < y1; ++y)
+    {
+        const float* row = &depth_buf[get_index(x0, y)];
+        for (int x = 0; x < x1 - x0; ++x)
+        {
+            z_far = std::max(z_far, row[x]);
+        }
+    }
+    hiz_buf[block_y * hiz_width + block_x] = z_far;
+}
+
 void rst::rasterizer::set_model(const Eigen::Matrix4f& m)
 {
     model = m;
@@ -355,15 +951,38 @@ void rst::rasterizer::set_projection(const Eigen::Matrix4f& p)
     projection = p;
 }
 
+void rst::rasterizer::set_near_far(float zNear, float zFar)
+{
+    z_near = zNear;
+    z_far = zFar;
+}
+
+void rst::rasterizer::set_scissor(const rect& area)
+{
+    scissor = {std::max(0, area.x0), std::max(0, area.y0), std::min(width, area.x1), std::min(height, area.y1)};
+}
+
+void rst::rasterizer::set_cull_mode(Cull mode)
+{
+    cull_mode = mode;
+}
+
 void rst::rasterizer::clear(rst::Buffers buff)
 {
+    int buffers = (int)(buff & (rst::Buffers::Color | rst::Buffers::Depth));
+    for (auto& flags : block_clears)
+    {
+        flags |= buffers;
+    }
     if ((buff & rst::Buffers::Color) == rst::Buffers::Color)
     {
-        std::fill(frame_buf.begin(), frame_buf.end(), Eigen::Vector3f{0, 0, 0});
+        color_clear_value = clear_color;
+        color_clears_pending = true;
     }
     if ((buff & rst::Buffers::Depth) == rst::Buffers::Depth)
     {
-        std::fill(depth_buf.begin(), depth_buf.end(), std::numeric_limits<float>::infinity());
+        std::fill(hiz_buf.begin(), hiz_buf.end(), std::numeric_limits<float>::infinity());
+        frame_counters = frame_stats{};
     }
 }
 
@@ -372,19 +991,31 @@ rst::rasterizer::rasterizer(int w, int h) : width(w), height(h)
     frame_buf.resize(w * h);
     depth_buf.resize(w * h);
 
+    scissor = {0, 0, w, h};
+
+    hiz_width = (w + hiz_block - 1) / hiz_block;
+    hiz_buf.resize(hiz_width * ((h + hiz_block - 1) / hiz_block));
+    block_clears.resize(hiz_buf.size());
+
     texture = std::nullopt;
+    span = get_span_kernel(detect_simd_level());
 }
 
 int rst::rasterizer::get_index(int x, int y)
 {
-    return (height-y)*width + x;
+    return (height-1-y)*width + x;
 }
 
 void rst::rasterizer::set_pixel(const Vector2i &point, const Eigen::Vector3f &color)
 {
     //old index: auto ind = point.y() + point.x() * width;
-    int ind = (height-point.y())*width + point.x();
-    frame_buf[ind] = color;
+    int ind = (height-1-point.y())*width + point.x();
+    int block = point.y() / hiz_block * hiz_width + point.x() / hiz_block;
+    if (block_clears[block])
+    {
+        materialize_block(block, block_clears[block]);
+    }
+    store_pixel(ind, color);
 }
 
 void rst::rasterizer::set_vertex_shader(std::function<Eigen::Vector3f(vertex_shader_payload)> vert_shader)
@@ -397,3 +1028,66 @@ void rst::rasterizer::set_fragment_shader(std::function<Eigen::Vector3f(fragment
     fragment_shader = frag_shader;
 }
 
+void rst::rasterizer::set_tile_size(int size)
+{
+    tile_size = std::max(hiz_block, (size + hiz_block - 1) / hiz_block * hiz_block);
+}
+
+void rst::rasterizer::set_simd_level(simd_level level)
+{
+    span = get_span_kernel(level);
+}
+
+void rst::rasterizer::set_format(Format f)
+{
+    format = f;
+    frame_buf.assign(format == Format::RGBFloat ? width * height : 0, Eigen::Vector3f{0, 0, 0});
+    bgra_buf.clear();
+    if (format == Format::BGRA8)
+    {
+        bgra_buf.resize(4 * width * height, 0);
+        for (size_t i = 3; i < bgra_buf.size(); i += 4)
+        {
+            bgra_buf[i] = 255;
+        }
+    }
+    planar_buf.assign(format == Format::PlanarFloat ? 3 * width * height : 0, 0.f);
+}
+
+cv::Mat rst::rasterizer::frame_image()
+{
+    resolve_clears();
+    switch (format)
+    {
+        case Format::BGRA8: return cv::Mat(height, width, CV_8UC4, bgra_buf.data());
+        case Format::PlanarFloat: return cv::Mat(3 * height, width, CV_32FC1, planar_buf.data());
+        default: return cv::Mat(height, width, CV_32FC3, frame_buf.data());
+    }
+}
+
+void rst::rasterizer::set_shading(Shading mode)
+{
+    shading = mode;
+    if (shading == Shading::Deferred)
+    {
+        visibility_buf.resize(width * height);
+    }
+}
+
+void rst::rasterizer::set_thread_count(int count)
+{
+    thread_count = std::max(1, count);
+    if (thread_count > 1 && (!pool || pool->size() != thread_count))
+    {
+        pool = std::make_unique<thread_pool>(thread_count);
+    }
+}
+
+// Specializations of draw(mesh, shader) for the shaders and packet shaders of shaders.hpp
+template void rst::rasterizer::draw(const MeshView&, const normal_shader&);
+template void rst::rasterizer::draw(const MeshView&, const phong_shader&);
+template void rst::rasterizer::draw(const MeshView&, const texture_shader&);
+template void rst::rasterizer::draw(const MeshView&, const bump_shader&);
+template void rst::rasterizer::draw(const MeshView&, const displacement_shader&);
+template void rst::rasterizer::draw(const MeshView&, const phong_packet_shader&);
+template void rst::rasterizer::draw(const MeshView&, const texture_packet_shader&);
@@ -7,9 +7,15 @@
 #include <eigen3/Eigen/Eigen>
 #include <optional>
 #include <algorithm>
+#include <memory>
 #include "global.hpp"
 #include "Shader.hpp"
 #include "Triangle.hpp"
+#include "clipping.hpp"
+#include "mesh.hpp"
+#include "mesh_simplify.hpp"
+#include "raster_simd.hpp"
+#include "thread_pool.hpp"
 
 using namespace Eigen;
 
@@ -37,6 +43,25 @@ namespace rst
         Triangle
     };
 
+    // Forward shades every fragment that passes the depth test. Deferred first rasterizes triangle
+    // id, barycentrics and depth into a visibility buffer, then shades each covered pixel once.
+    enum class Shading
+    {
+        Forward,
+        Deferred
+    };
+
+    // Storage of the color buffer. RGBFloat keeps the unclamped shader output per pixel (the
+    // frame_buffer() vector). BGRA8 clamps, rounds and swizzles every write into the byte order
+    // OpenCV displays and writes. PlanarFloat keeps unclamped R, G and B in separate planes, for
+    // HDR processing.
+    enum class Format
+    {
+        RGBFloat,
+        BGRA8,
+        PlanarFloat
+    };
+
     /*
      * For the curious : The draw function takes two buffer id's as its arguments. These two structs
      * make sure that if you mix up with their orders, the compiler won't compile it.
@@ -57,6 +82,63 @@ namespace rst
         int col_id = 0;
     };
 
+    // Which screen-space winding is discarded by the culling stage. Front faces are counter
+    // clockwise in normalized device coordinates, like the vertex order of Triangle.
+    enum class Cull
+    {
+        None,
+        Back,
+        Front
+    };
+
+    // Per-frame counters, reset by clear(Buffers::Depth).
+    struct frame_stats
+    {
+        // Culling stage: triangles submitted to draw(), and rejected by the view frustum test or
+        // by the face (winding) test.
+        long triangles_submitted = 0;
+        long triangles_frustum_culled = 0;
+        long triangles_face_culled = 0;
+        // Triangles that crossed the near plane or the guard band and were clipped.
+        long triangles_clipped = 0;
+
+        // Hierarchical-Z: 8x8 blocks of a triangle's bounding box that were tested against / rejected
+        // by the coarse depth buffer, and the pixels those rejected blocks would have visited.
+        long hiz_blocks_tested = 0;
+        long hiz_blocks_culled = 0;
+        long hiz_pixels_culled = 0;
+
+        // Fragment shader invocations.
+        long fragments_shaded = 0;
+
+        frame_stats& operator+=(const frame_stats& other)
+        {
+            triangles_submitted += other.triangles_submitted;
+            triangles_frustum_culled += other.triangles_frustum_culled;
+            triangles_face_culled += other.triangles_face_culled;
+            triangles_clipped += other.triangles_clipped;
+            hiz_blocks_tested += other.hiz_blocks_tested;
+            hiz_blocks_culled += other.hiz_blocks_culled;
+            hiz_pixels_culled += other.hiz_pixels_culled;
+            fragments_shaded += other.fragments_shaded;
+            return *this;
+        }
+    };
+
+    // Where a bounding box lies against the view frustum.
+    enum class Visibility
+    {
+        Outside,
+        Partial,
+        Inside
+    };
+
+    // Half-open pixel rectangle [x0, x1) x [y0, y1)
+    struct rect
+    {
+        int x0, y0, x1, y1;
+    };
+
     class rasterizer
     {
     public:
@@ -65,29 +147,150 @@ namespace rst
         ind_buf_id load_indices(const std::vector<Eigen::Vector3i>& indices);
         col_buf_id load_colors(const std::vector<Eigen::Vector3f>& colors);
         col_buf_id load_normals(const std::vector<Eigen::Vector3f>& normals);
+        col_buf_id load_texcoords(const std::vector<Eigen::Vector2f>& tex_coords);
 
         void set_model(const Eigen::Matrix4f& m);
         void set_view(const Eigen::Matrix4f& v);
         void set_projection(const Eigen::Matrix4f& p);
 
-        void set_texture(Texture tex) { texture = tex; }
+        // Near/far distances the projection was built with. They define the depth mapping of the
+        // viewport transform and the near/far planes of frustum culling.
+        void set_near_far(float zNear, float zFar);
+
+        void set_cull_mode(Cull mode);
+
+        // Pixels outside the scissor rectangle are never rasterized. Defaults to the whole viewport.
+        void set_scissor(const rect& area);
+
+        void set_texture(Texture tex) { texture = std::move(tex); bound_texture = &*texture; }
+        // Binds a texture without copying it, for draws that switch between shared textures. It must
+        // outlive the draws that use it; null binds none.
+        void bind_texture(const Texture* tex) { bound_texture = tex; }
+
+        // Lights, camera and material for the shaders, in world space (see uniform_block).
+        void set_uniforms(const uniform_block& block) { uniforms = block; }
 
         void set_vertex_shader(std::function<Eigen::Vector3f(vertex_shader_payload)> vert_shader);
         void set_fragment_shader(std::function<Eigen::Vector3f(fragment_shader_payload)> frag_shader);
 
+        // Sort-middle mode: triangles are binned into tile_size x tile_size screen tiles which are
+        // rasterized in parallel. A thread count of 1 keeps the serial per-triangle path.
+        // The tile size is rounded up to a multiple of the 8x8 hierarchical-Z block.
+        void set_tile_size(int size);
+        void set_thread_count(int count);
+
+        // Pixel kernel used by rasterize_triangle; defaults to the best level the CPU supports.
+        void set_simd_level(simd_level level);
+
+        void set_shading(Shading mode);
+
         void set_pixel(const Vector2i &point, const Eigen::Vector3f &color);
 
+        // Marks the buffers as cleared; see block_clears for when the memory is actually written.
         void clear(Buffers buff);
 
+        // Value clear(Buffers::Color) clears to, in the 0-255 range of the shaders. Black by default.
+        void set_clear_color(const Eigen::Vector3f& color) { clear_color = color; }
+
+        // Indexed draw: every vertex of pos_buffer is transformed once, and the triangles of ind_buffer
+        // are assembled from the transformed vertices. Normals and texture coordinates come from the
+        // buffers last passed to load_normals / load_texcoords; colors are in the 0-255 range.
         void draw(pos_buf_id pos_buffer, ind_buf_id ind_buffer, col_buf_id col_buffer, Primitive type);
         void draw(std::vector<Triangle *> &TriangleList);
+        // Draws the arrays of a Mesh, or of a mapped mesh cache, in place.
+        void draw(const MeshView& mesh);
 
-        std::vector<Eigen::Vector3f>& frame_buffer() { return frame_buf; }
+        // draw(mesh) with the fragment shader as a template argument instead of the std::function of
+        // set_fragment_shader, so it is inlined into its own copy of the raster loops. The shader is
+        // either a per-fragment one or a packet shader that shades a span at a time. Instantiated in
+        // rasterizer.cpp for the shader types of shaders.hpp.
+        template<typename Shader>
+        void draw(const MeshView& mesh, const Shader& shader);
+
+        // The level of lods to draw with the current matrices: the coarsest whose error, projected
+        // at the distance of its bounding sphere, stays within pixel_error pixels. 0 when the camera
+        // is inside the sphere.
+        int select_lod(const lod_chain& lods, float pixel_error = 0.5f) const;
+
+        // draw(mesh, shader) with the level select_lod picks.
+        template<typename Shader>
+        void draw(const lod_chain& lods, const Shader& shader) { draw(lods.level(select_lod(lods)), shader); }
+
+        // Tests a world space box against the frustum of the current view and projection and near/far
+        // distances, with the test of the triangle culling stage: Outside when all eight corners are
+        // beyond one plane, Inside when all are within every plane.
+        Visibility box_visibility(const Eigen::AlignedBox3f& box) const;
+
+        void set_format(Format f);
+
+        // Color buffer of the RGBFloat format
+        std::vector<Eigen::Vector3f>& frame_buffer() { resolve_clears(); return frame_buf; }
+
+        // The color buffer as a cv::Mat over the rasterizer's memory, no copy: CV_32FC3 in RGB order,
+        // CV_8UC4 BGRA ready for imshow / write_image, or for PlanarFloat a CV_32FC1 of the R, G and B
+        // planes stacked vertically. Valid until the next set_format.
+        cv::Mat frame_image();
+
+        const frame_stats& stats() const { return frame_counters; }
 
     private:
         void draw_line(Eigen::Vector3f begin, Eigen::Vector3f end);
 
-        void rasterize_triangle(const Triangle& t, const std::array<Eigen::Vector3f, 3>& world_pos);
+        // Per-draw state of the vertex stage, computed once by begin_draw() instead of per triangle.
+        struct vertex_transform
+        {
+            Eigen::Matrix4f mvp;
+            Eigen::Matrix4f model_view;
+            Eigen::Matrix3f normal_matrix;  // inverse transpose of model_view
+            float w_sign;                   // makes clip w positive in front of the camera
+            clip_space space;
+        };
+
+        // Vertex cache entry: a transformed vertex and its frustum outcode.
+        struct cached_vertex
+        {
+            clip_vertex vertex;
+            int outcode;
+        };
+
+        // Also moves the uniform block into view space for the shaders of this draw.
+        vertex_transform begin_draw();
+        cached_vertex transform_vertex(const vertex_transform& xf, const Eigen::Vector4f& position, const Eigen::Vector3f& normal,
+                                       const Eigen::Vector2f& tex_coords, const Eigen::Vector3f& color) const;
+
+        // Fills vertex_cache from attribute arrays of count vertices. Missing (null) attributes are
+        // zero; colors are scaled by color_scale into the 0-1 range.
+        void transform_vertices(const vertex_transform& xf, size_t count, const Eigen::Vector3f* positions, const Eigen::Vector3f* normals,
+                                const Eigen::Vector2f* tex_coords, const Eigen::Vector3f* colors, float color_scale);
+
+        // Culls and clips one triangle of vertex_cache and appends what is left to primitives.
+        void assemble_triangle(const vertex_transform& xf, int i0, int i1, int i2);
+
+        void assemble_mesh(const MeshView& mesh);
+
+        // Rasterizes (and in deferred mode resolves) everything assemble_triangle produced. The stages
+        // below are templated on the fragment shader: either the std::function set by
+        // set_fragment_shader, or a shader type passed to draw(mesh, shader).
+        template<typename Shader>
+        void rasterize_primitives(const Shader& shader);
+
+        template<typename Shader>
+        void rasterize_triangle(const Triangle& t, const std::array<Eigen::Vector3f, 3>& world_pos, int id, const rect& clip, frame_stats& stats, const Shader& shader);
+
+        template<typename Shader>
+        void draw_tiled(const std::vector<Triangle>& triangles, const std::vector<std::array<Eigen::Vector3f, 3>>& view_positions, const Shader& shader);
+
+        template<typename Shader>
+        void resolve_visibility(const std::vector<Triangle>& triangles, const std::vector<std::array<Eigen::Vector3f, 3>>& view_positions, const rect& area, const Shader& shader);
+
+        // Runs the fragment shader on one fragment's interpolated attributes (indexed by attr_*).
+        template<typename Shader>
+        Eigen::Vector3f shade_fragment(const Shader& shader, const float* values);
+
+        // Shades the lanes of mask and stores their colors to pixels index + lane. Packet shaders (see
+        // is_packet_shader) get the whole span in one call, others one fragment at a time.
+        template<typename Shader>
+        void shade_span(const Shader& shader, const fragment_lanes& lanes, unsigned mask, int index);
 
         void get_bounding_box(const Triangle &t, Eigen::Vector2f *bounding_box_x, Eigen::Vector2f *bounding_box_y);
 
@@ -98,24 +301,83 @@ namespace rst
         Eigen::Matrix4f view;
         Eigen::Matrix4f projection;
 
+        float z_near = 0.1f;
+        float z_far = 50.f;
+        Cull cull_mode = Cull::None;
+        rect scissor;
+
         int normal_id = -1;
+        int texcoord_id = -1;
 
         std::map<int, std::vector<Eigen::Vector3f>> pos_buf;
         std::map<int, std::vector<Eigen::Vector3i>> ind_buf;
         std::map<int, std::vector<Eigen::Vector3f>> col_buf;
         std::map<int, std::vector<Eigen::Vector3f>> nor_buf;
+        std::map<int, std::vector<Eigen::Vector2f>> tex_buf;
+
+        // Output of the vertex stage and of primitive assembly, kept across draws to reuse storage.
+        std::vector<cached_vertex> vertex_cache;
+        std::vector<Triangle> primitives;
+        std::vector<std::array<Eigen::Vector3f, 3>> primitive_view_pos;
 
         std::optional<Texture> texture;
+        const Texture* bound_texture = nullptr;  // what the shaders sample: &*texture or bind_texture's
+
+        uniform_block uniforms;
+        uniform_block view_uniforms;
 
         std::function<Eigen::Vector3f(fragment_shader_payload)> fragment_shader;
         std::function<Eigen::Vector3f(vertex_shader_payload)> vertex_shader;
 
+        Format format = Format::RGBFloat;
         std::vector<Eigen::Vector3f> frame_buf;
+        std::vector<uint8_t> bgra_buf;
+        std::vector<float> planar_buf;
+
+        // Writes a shaded color to pixel index (as get_index) in the active format
+        void store_pixel(int index, const Eigen::Vector3f& color);
         std::vector<float> depth_buf;
         int get_index(int x, int y);
 
+        // Coarse depth: farthest depth_buf value of every hiz_block x hiz_block block, so a block a
+        // triangle cannot pass anywhere is skipped before any per-pixel work.
+        static constexpr int hiz_block = span_width;
+        std::vector<float> hiz_buf;
+        int hiz_width;
+        void update_hiz(int block_x, int block_y);
+
+        // Fast clear: clear() only sets the cleared buffers' bits (as in Buffers) for every hiz block
+        // instead of filling the buffers. A block is filled with the clear values when a triangle or
+        // set_pixel first reaches it, and the color of blocks still marked is filled when the frame
+        // is read (resolve_clears). Depth of blocks nothing was drawn to is never written.
+        std::vector<uint8_t> block_clears;
+        bool color_clears_pending = false;
+        Eigen::Vector3f clear_color = {0, 0, 0};
+        Eigen::Vector3f color_clear_value = {0, 0, 0};  // clear_color at the last clear
+        void materialize_block(int block, int buffers);
+        void resolve_clears();
+
+        frame_stats frame_counters;
+
+        // Visibility buffer of the deferred mode, indexed like depth_buf. triangle is the index into
+        // the current draw call's triangle list, or -1 when the draw did not cover the pixel. Only
+        // the rectangle around the draw's triangles is cleared; outside it samples are stale.
+        struct visibility_sample
+        {
+            int triangle;
+            float alpha, beta, gamma;
+        };
+        Shading shading = Shading::Forward;
+        std::vector<visibility_sample> visibility_buf;
+
         int width, height;
 
+        int tile_size = 64;
+        int thread_count = 1;
+        std::unique_ptr<thread_pool> pool;
+
+        span_kernel span;
+
         int next_id = 0;
         int get_next_id() { return next_id++; }
     };
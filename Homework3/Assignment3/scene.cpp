@@ -0,0 +1,267 @@
+//
+// Scene of mesh instances, frustum culled per object through a bounding volume hierarchy.
+//
+
+#include <algorithm>
+#include "scene.hpp"
+#include "shaders.hpp"
+
+namespace
+{
+    // Leaves hold at most this many instances
+    constexpr uint32_t leaf_size = 4;
+
+    // Box around the eight transformed corners of box
+    Eigen::AlignedBox3f transform_box(const Eigen::Matrix4f& m, const Eigen::AlignedBox3f& box)
+    {
+        Eigen::AlignedBox3f out;
+        if (box.isEmpty())
+        {
+            return out;
+        }
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            out.extend((m * box.corner(Eigen::AlignedBox3f::CornerType(corner)).homogeneous()).hnormalized());
+        }
+        return out;
+    }
+
+    float surface_area(const Eigen::AlignedBox3f& box)
+    {
+        if (box.isEmpty())
+        {
+            return 0;
+        }
+        Eigen::Vector3f size = box.sizes();
+        return 2 * (size.x() * size.y() + size.y() * size.z() + size.z() * size.x());
+    }
+
+    template<typename Shader>
+    void draw_instance(rst::rasterizer& r, const rst::Instance& instance, const Shader& shader)
+    {
+        if (instance.lods)
+        {
+            r.draw(*instance.lods, shader);
+        }
+        else
+        {
+            r.draw(instance.mesh, shader);
+        }
+    }
+}
+
+int rst::Scene::add(const MeshView& mesh, const Eigen::Matrix4f& model, Material material, const Texture* texture)
+{
+    auto known = mesh_bounds.find(mesh.positions);
+    if (known == mesh_bounds.end())
+    {
+        Eigen::AlignedBox3f bounds;
+        for (size_t v = 0; v < mesh.vertex_count; ++v)
+        {
+            bounds.extend(mesh.positions[v]);
+        }
+        known = mesh_bounds.emplace(mesh.positions, bounds).first;
+    }
+
+    Instance instance;
+    instance.mesh = mesh;
+    instance.model = model;
+    instance.material = material;
+    instance.texture = texture;
+    instance.mesh_bounds = known->second;
+    return add_instance(instance);
+}
+
+int rst::Scene::add(const lod_chain& lods, const Eigen::Matrix4f& model, Material material, const Texture* texture)
+{
+    int id = add(lods.level(0), model, material, texture);
+    instances[id].lods = &lods;
+    return id;
+}
+
+int rst::Scene::add_instance(Instance instance)
+{
+    instance.bounds = transform_box(instance.model, instance.mesh_bounds);
+    instances.push_back(instance);
+    build_pending = true;
+    return (int)instances.size() - 1;
+}
+
+void rst::Scene::set_model(int id, const Eigen::Matrix4f& model)
+{
+    Instance& instance = instances[id];
+    instance.model = model;
+    instance.bounds = transform_box(model, instance.mesh_bounds);
+    refit_pending = true;
+}
+
+void rst::Scene::update()
+{
+    counters.rebuilt = counters.refit = false;
+    if (build_pending)
+    {
+        rebuild();
+        return;
+    }
+    if (!refit_pending)
+    {
+        return;
+    }
+    refit();
+    counters.refit = true;
+    if (tree_area() > rebuild_ratio * built_area)
+    {
+        rebuild();
+    }
+}
+
+void rst::Scene::rebuild()
+{
+    order.resize(instances.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    nodes.clear();
+    if (!instances.empty())
+    {
+        build(0, order.size());
+    }
+    built_area = tree_area();
+    build_pending = refit_pending = false;
+    counters.rebuilt = true;
+}
+
+void rst::Scene::build(uint32_t begin, uint32_t end)
+{
+    uint32_t index = nodes.size();
+    nodes.push_back({});
+    Eigen::AlignedBox3f bounds, centers;
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        bounds.extend(instances[order[i]].bounds);
+        centers.extend(instances[order[i]].bounds.center());
+    }
+    nodes[index].bounds = bounds;
+    if (end - begin <= leaf_size)
+    {
+        nodes[index].first = begin;
+        nodes[index].count = end - begin;
+        return;
+    }
+
+    // Median split along the longest side of the centers' box
+    int axis;
+    centers.sizes().maxCoeff(&axis);
+    uint32_t middle = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](uint32_t a, uint32_t b) {
+        return instances[a].bounds.center()[axis] < instances[b].bounds.center()[axis];
+    });
+    build(begin, middle);
+    nodes[index].first = nodes.size();
+    nodes[index].count = 0;
+    build(middle, end);
+}
+
+void rst::Scene::refit()
+{
+    // Children come after their parent, so a backward pass sees them first
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        node& n = nodes[i];
+        n.bounds.setEmpty();
+        if (n.count > 0)
+        {
+            for (uint32_t j = n.first; j < n.first + n.count; ++j)
+            {
+                n.bounds.extend(instances[order[j]].bounds);
+            }
+        }
+        else
+        {
+            n.bounds.extend(nodes[i + 1].bounds);
+            n.bounds.extend(nodes[n.first].bounds);
+        }
+    }
+    refit_pending = false;
+}
+
+float rst::Scene::tree_area() const
+{
+    float area = 0;
+    for (const node& n : nodes)
+    {
+        area += surface_area(n.bounds);
+    }
+    return area;
+}
+
+void rst::Scene::cull(const rasterizer& r, std::vector<int>& visible)
+{
+    visible.clear();
+    counters.nodes_visited = 0;
+    if (nodes.empty())
+    {
+        counters.instances_culled = 0;
+        return;
+    }
+
+    // Nodes to visit, and whether an ancestor was found entirely inside the frustum
+    std::vector<std::pair<uint32_t, bool>> stack = {{0, false}};
+    while (!stack.empty())
+    {
+        auto [index, inside] = stack.back();
+        stack.pop_back();
+        const node& n = nodes[index];
+        if (!inside)
+        {
+            counters.nodes_visited++;
+            Visibility visibility = r.box_visibility(n.bounds);
+            if (visibility == Visibility::Outside)
+            {
+                continue;
+            }
+            inside = visibility == Visibility::Inside;
+        }
+        if (n.count > 0)
+        {
+            for (uint32_t j = n.first; j < n.first + n.count; ++j)
+            {
+                uint32_t id = order[j];
+                // A leaf's box may hold several instances; test each against the frustum as well
+                if (inside || n.count == 1 || r.box_visibility(instances[id].bounds) != Visibility::Outside)
+                {
+                    visible.push_back(id);
+                }
+            }
+        }
+        else
+        {
+            stack.push_back({n.first, inside});
+            stack.push_back({index + 1, inside});
+        }
+    }
+    std::sort(visible.begin(), visible.end());
+    counters.instances_culled = instances.size() - visible.size();
+}
+
+void rst::Scene::draw(rasterizer& r)
+{
+    update();
+    cull(r, visible);
+    for (int id : visible)
+    {
+        const Instance& instance = instances[id];
+        r.set_model(instance.model);
+        r.bind_texture(instance.texture);
+        switch (instance.material)
+        {
+            case Material::Normal: draw_instance(r, instance, normal_shader{}); break;
+            case Material::Texture: draw_instance(r, instance, texture_shader{}); break;
+            case Material::Bump: draw_instance(r, instance, bump_shader{}); break;
+            case Material::Displacement: draw_instance(r, instance, displacement_shader{}); break;
+            default: draw_instance(r, instance, phong_shader{}); break;
+        }
+    }
+    counters.instances_drawn = visible.size();
+}
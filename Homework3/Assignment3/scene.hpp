@@ -0,0 +1,125 @@
+//
+// Scene of mesh instances, frustum culled per object through a bounding volume hierarchy.
+//
+
+#ifndef RASTERIZER_SCENE_H
+#define RASTERIZER_SCENE_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <eigen3/Eigen/Eigen>
+
+#include "mesh.hpp"
+#include "mesh_simplify.hpp"
+#include "rasterizer.hpp"
+#include "Texture.hpp"
+
+namespace rst
+{
+    // Fragment shader of an instance, one of the shader types of shaders.hpp.
+    enum class Material
+    {
+        Normal,
+        Phong,
+        Texture,
+        Bump,
+        Displacement
+    };
+
+    // A mesh placed in the world. The texture is what the Texture material samples, and the height
+    // map of Bump and Displacement.
+    struct Instance
+    {
+        MeshView mesh;
+        const lod_chain* lods = nullptr;  // drawn instead of mesh when set (rasterizer::select_lod)
+        Eigen::Matrix4f model;
+        Material material = Material::Phong;
+        const Texture* texture = nullptr;
+        Eigen::AlignedBox3f mesh_bounds;  // of the mesh, in model space
+        Eigen::AlignedBox3f bounds;       // mesh_bounds transformed by model, in world space
+    };
+
+    // Counters of the last update() and draw().
+    struct scene_stats
+    {
+        bool rebuilt = false;
+        bool refit = false;
+        long nodes_visited = 0;      // hierarchy boxes tested against the frustum
+        long instances_culled = 0;
+        long instances_drawn = 0;
+    };
+
+    // Instances and a bounding volume hierarchy over their world bounds. Draws test the hierarchy
+    // against the frustum first, so objects entirely outside it cost no vertex work, and subtrees
+    // entirely inside it no further tests. Meshes, level of detail chains and textures are referenced,
+    // not copied, and must outlive the scene.
+    class Scene
+    {
+    public:
+        // Returns the id of the new instance, its index in the order of add.
+        int add(const MeshView& mesh, const Eigen::Matrix4f& model, Material material, const Texture* texture = nullptr);
+        int add(const lod_chain& lods, const Eigen::Matrix4f& model, Material material, const Texture* texture = nullptr);
+
+        // Moves an instance; the hierarchy is refit at the next update().
+        void set_model(int id, const Eigen::Matrix4f& model);
+
+        const Instance& instance(int id) const { return instances[id]; }
+        int size() const { return (int)instances.size(); }
+
+        // Refitting keeps the tree and only grows or shrinks its boxes, which loosens them as instances
+        // move apart. The tree is rebuilt instead when the refit boxes add up to more than ratio times
+        // the surface area they had after the last build. 2 by default.
+        void set_rebuild_ratio(float ratio) { rebuild_ratio = ratio; }
+
+        // Brings the hierarchy up to date with the instances: rebuilt after add(), refit after
+        // set_model(). draw() calls it; nothing happens when nothing changed.
+        void update();
+        // Rebuilds the hierarchy even if a refit would do.
+        void rebuild();
+
+        // Ids of the instances whose bounds are not outside the frustum of r's view and projection,
+        // in increasing order. Call update() first after changes.
+        void cull(const rasterizer& r, std::vector<int>& visible);
+
+        // Draws the instances that pass cull(), in the order they were added, with r's view,
+        // projection and uniforms. Leaves r's model matrix and bound texture at the last instance's.
+        void draw(rasterizer& r);
+
+        // Sum of the surface areas of the hierarchy's boxes; lower culls with fewer tests.
+        float tree_area() const;
+
+        const scene_stats& stats() const { return counters; }
+
+    private:
+        // Depth-first layout: an inner node's children are the next node and node right. A leaf
+        // holds order[first, first + count).
+        struct node
+        {
+            Eigen::AlignedBox3f bounds;
+            uint32_t first;  // leaf: first entry of order; inner: the right child
+            uint32_t count;  // 0 for an inner node
+        };
+
+        int add_instance(Instance instance);
+        // Builds the subtree of order[begin, end) at the end of nodes
+        void build(uint32_t begin, uint32_t end);
+        void refit();
+
+        std::vector<Instance> instances;
+        std::vector<uint32_t> order;  // instance ids, grouped by leaf
+        std::vector<node> nodes;
+        // Bounds of each mesh added, by its positions, so instances of one mesh share the scan
+        std::map<const Eigen::Vector3f*, Eigen::AlignedBox3f> mesh_bounds;
+
+        bool build_pending = false;
+        bool refit_pending = false;
+        float built_area = 0;
+        float rebuild_ratio = 2;
+        scene_stats counters;
+
+        std::vector<int> visible;  // scratch of draw()
+    };
+}
+
+#endif //RASTERIZER_SCENE_H
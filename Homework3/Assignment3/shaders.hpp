@@ -0,0 +1,309 @@
+//
+// The homework shaders, as inline functions and as shader types for rasterizer::draw(mesh, shader).
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <eigen3/Eigen/Eigen>
+#include "Shader.hpp"
+#include "Texture.hpp"
+
+inline Eigen::Vector3f vertex_shader(const vertex_shader_payload& payload)
+{
+    return payload.position;
+}
+
+inline Eigen::Vector3f normal_fragment_shader(const fragment_shader_payload& payload)
+{
+    Eigen::Vector3f return_color = (payload.normal.head<3>().normalized() + Eigen::Vector3f(1.0f, 1.0f, 1.0f)) / 2.f;
+    Eigen::Vector3f result;
+    result << return_color.x() * 255, return_color.y() * 255, return_color.z() * 255;
+    return result;
+}
+
+inline Eigen::Vector3f reflect(const Eigen::Vector3f& vec, const Eigen::Vector3f& axis)
+{
+    auto costheta = vec.dot(axis);
+    return (2 * costheta * axis - vec).normalized();
+}
+
+inline Eigen::Vector3f texture_fragment_shader(const fragment_shader_payload& payload)
+{
+    Eigen::Vector3f return_color = {0, 0, 0};
+    if (payload.texture)
+    {
+        return_color = payload.texture->sample(payload.tex_coords[0], payload.tex_coords[1], payload.tex_coords_dx, payload.tex_coords_dy);
+    }
+    Eigen::Vector3f texture_color;
+    texture_color << return_color.x(), return_color.y(), return_color.z();
+
+    const uniform_block& uniforms = *payload.uniforms;
+    const Eigen::Vector3f& ka = uniforms.ka;
+    Eigen::Vector3f kd = texture_color / 255.f;
+    const Eigen::Vector3f& ks = uniforms.ks;
+
+    const Eigen::Vector3f& amb_light_intensity = uniforms.ambient_intensity;
+    const Eigen::Vector3f& eye_pos = uniforms.eye_pos;
+
+    float p = uniforms.shininess;
+
+    Eigen::Vector3f point = payload.view_pos;
+    Eigen::Vector3f normal = payload.normal;
+
+    Eigen::Vector3f result_color = {0, 0, 0};
+
+    for (int i = 0; i < uniforms.light_count; ++i)
+    {
+        const auto& light = uniforms.lights[i];
+        // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
+        // components are. Then, accumulate that result on the *result_color* object.
+        float r = (point - light.position).norm();
+        auto intensity = light.intensity / (r * r); 
+        Eigen::Vector3f light_dir = (light.position - point).normalized();
+        Eigen::Vector3f eye_dir = (eye_pos - point).normalized();
+        Eigen::Vector3f half_dir = (light_dir + eye_dir).normalized();
+        // 环境光
+        Eigen::Vector3f color_a = ka.cwiseProduct(amb_light_intensity);
+        // 漫反射光
+        Eigen::Vector3f color_d = std::max<float>(0, normal.dot(light_dir)) * kd.cwiseProduct(intensity);
+        // 高光
+        Eigen::Vector3f color_s = std::pow(std::max<float>(0, half_dir.dot(normal)), p) * ks.cwiseProduct(intensity);
+        result_color += (color_a + color_d + color_s); 
+    }
+
+    return result_color * 255.f;
+}
+
+inline Eigen::Vector3f phong_fragment_shader(const fragment_shader_payload& payload)
+{
+    const uniform_block& uniforms = *payload.uniforms;
+    const Eigen::Vector3f& ka = uniforms.ka;
+    Eigen::Vector3f kd = payload.color;
+    const Eigen::Vector3f& ks = uniforms.ks;
+
+    const Eigen::Vector3f& amb_light_intensity = uniforms.ambient_intensity;
+    const Eigen::Vector3f& eye_pos = uniforms.eye_pos;
+
+    float p = uniforms.shininess;
+
+    Eigen::Vector3f point = payload.view_pos;
+    Eigen::Vector3f normal = payload.normal;
+    // std::cout << "normal:" << normal << std::endl;
+
+
+    Eigen::Vector3f result_color = {0, 0, 0};
+    for (int i = 0; i < uniforms.light_count; ++i)
+    {
+      const auto& light = uniforms.lights[i];
+      // TODO: For each light source in the code, calculate what the *ambient*, *diffuse*, and *specular* 
+      // components are. Then, accumulate that result on the *result_color* object.
+
+      float r = (point - light.position).norm();
+      auto intensity = light.intensity / (r * r); 
+      Eigen::Vector3f light_dir = (light.position - point).normalized();
+      Eigen::Vector3f eye_dir = (eye_pos - point).normalized();
+      Eigen::Vector3f half_dir = (light_dir + eye_dir).normalized();
+
+      // 环境光
+      Eigen::Vector3f color_a = ka.cwiseProduct(amb_light_intensity);
+
+      // 漫反射光
+      Eigen::Vector3f color_d = std::max<float>(0, normal.dot(light_dir)) * kd.cwiseProduct(intensity);
+
+      // 高光
+      Eigen::Vector3f color_s = std::pow(std::max<float>(0, half_dir.dot(normal)), p) * ks.cwiseProduct(intensity);
+
+
+      result_color += (color_a + color_d + color_s); 
+    }
+
+    return result_color * 255.f;
+}
+
+
+
+inline Eigen::Vector3f displacement_fragment_shader(const fragment_shader_payload& payload)
+{
+    const uniform_block& uniforms = *payload.uniforms;
+
+    // TODO: Implement displacement mapping here, with kh = 0.2, kn = 0.1
+    // Let n = normal = (x, y, z)
+    // Vector t = (x*y/sqrt(x*x+z*z),sqrt(x*x+z*z),z*y/sqrt(x*x+z*z))
+    // Vector b = n cross product t
+    // Matrix TBN = [t b n]
+    // dU = kh * kn * (h(u+1/w,v)-h(u,v))
+    // dV = kh * kn * (h(u,v+1/h)-h(u,v))
+    // Vector ln = (-dU, -dV, 1)
+    // Position p = p + kn * n * h(u,v)
+    // Normal n = normalize(TBN * ln)
+
+
+    Eigen::Vector3f result_color = {0, 0, 0};
+
+    for (int i = 0; i < uniforms.light_count; ++i)
+    {
+        // TODO: For each light source (uniforms.lights[i]), calculate what the *ambient*, *diffuse*, and *specular*
+        // components are. Then, accumulate that result on the *result_color* object.
+    }
+
+    return result_color * 255.f;
+}
+
+
+inline Eigen::Vector3f bump_fragment_shader(const fragment_shader_payload& payload)
+{
+    Eigen::Vector3f normal = payload.normal;
+
+    float kh = 0.2, kn = 0.1;
+
+    // TODO: Implement bump mapping here
+    // Let n = normal = (x, y, z)
+    // Vector t = (x*y/sqrt(x*x+z*z),sqrt(x*x+z*z),z*y/sqrt(x*x+z*z))
+    // Vector b = n cross product t
+    // Matrix TBN = [t b n]
+    // dU = kh * kn * (h(u+1/w,v)-h(u,v))
+    // dV = kh * kn * (h(u,v+1/h)-h(u,v))
+    // Vector ln = (-dU, -dV, 1)
+    // Normal n = normalize(TBN * ln)
+
+    float x = normal.x();
+    float y = normal.y();
+
+    // Eigen::Vector3f t = Eigen::Vector3f(x * y / std::sqrt(x * x + z * z), std::sqrt(x * x + z * z), z * y / std::sqrt(x * x + z * z));
+    Eigen::Vector3f t = Eigen::Vector3f(-y / std::sqrt(x * x + y * y), x / sqrt(x * x + y * y), 0);
+
+    Eigen::Vector3f b = normal.cross(t);
+
+    Eigen::Matrix3f TBN;
+    TBN << t.x(), b.x(), normal.x(),
+        t.y(), b.y(), normal.y(),
+        t.z(), b.z(), normal.z();
+
+    float u = payload.tex_coords.x();
+    float v = payload.tex_coords.y();
+    float w = payload.texture->width;
+    float h = payload.texture->height;
+
+    float dU = kh * kn * (payload.texture->getColor(u + 1.0f / w, v).norm() - payload.texture->getColor(u, v).norm());
+    float dV = kh * kn * (payload.texture->getColor(u, v + 1.0f / h).norm() - payload.texture->getColor(u, v).norm());
+
+    Eigen::Vector3f ln = Eigen::Vector3f(-dU, -dV, 1.0f);
+    normal = TBN * ln;
+
+    Eigen::Vector3f result_color = {0, 0, 0};
+    result_color = normal.normalized();
+
+    return result_color * 255.f;
+}
+
+// Shader types for the templated rasterizer::draw(mesh, shader): the fragment shader is a template
+// argument there, so each of these is inlined into its own copy of the raster loops.
+struct normal_shader
+{
+    Eigen::Vector3f operator()(const fragment_shader_payload& payload) const { return normal_fragment_shader(payload); }
+};
+
+struct phong_shader
+{
+    Eigen::Vector3f operator()(const fragment_shader_payload& payload) const { return phong_fragment_shader(payload); }
+};
+
+struct texture_shader
+{
+    Eigen::Vector3f operator()(const fragment_shader_payload& payload) const { return texture_fragment_shader(payload); }
+};
+
+struct bump_shader
+{
+    Eigen::Vector3f operator()(const fragment_shader_payload& payload) const { return bump_fragment_shader(payload); }
+};
+
+struct displacement_shader
+{
+    Eigen::Vector3f operator()(const fragment_shader_payload& payload) const { return displacement_fragment_shader(payload); }
+};
+
+// Span versions of phong_fragment_shader and texture_fragment_shader for the packet interface: the
+// same Blinn-Phong lighting with the uniform block's lights, computed over the SoA inputs of the
+// covered lanes only (spans along triangle edges are mostly partial, and std::pow dominates a lane).
+inline void blinn_phong_packet(const fragment_packet& in, const float (*kd)[packet_width], color_packet& out)
+{
+    const uniform_block& uniforms = *in.uniforms;
+    const Eigen::Vector3f ambient = uniforms.ka.cwiseProduct(uniforms.ambient_intensity);
+    const Eigen::Vector3f& eye_pos = uniforms.eye_pos;
+
+    for (unsigned mask = in.mask; mask; mask &= mask - 1)
+    {
+        int lane = __builtin_ctz(mask);
+        float n[3] = {in.normal[0][lane], in.normal[1][lane], in.normal[2][lane]};
+        float n_len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        float point[3] = {in.view_pos[0][lane], in.view_pos[1][lane], in.view_pos[2][lane]};
+
+        float eye_dir[3] = {eye_pos[0] - point[0], eye_pos[1] - point[1], eye_pos[2] - point[2]};
+        float eye_len = std::sqrt(eye_dir[0] * eye_dir[0] + eye_dir[1] * eye_dir[1] + eye_dir[2] * eye_dir[2]);
+
+        float result[3] = {0, 0, 0};
+        for (int i = 0; i < uniforms.light_count; ++i)
+        {
+            const auto& light = uniforms.lights[i];
+            float light_dir[3] = {light.position[0] - point[0], light.position[1] - point[1], light.position[2] - point[2]};
+            float r2 = light_dir[0] * light_dir[0] + light_dir[1] * light_dir[1] + light_dir[2] * light_dir[2];
+            float light_len = std::sqrt(r2);
+
+            float half_dir[3], n_dot_l = 0, n_dot_h = 0, half_len = 0;
+            for (int c = 0; c < 3; ++c)
+            {
+                half_dir[c] = light_dir[c] / light_len + eye_dir[c] / eye_len;
+                half_len += half_dir[c] * half_dir[c];
+                n_dot_l += n[c] * light_dir[c];
+            }
+            half_len = std::sqrt(half_len);
+            for (int c = 0; c < 3; ++c)
+            {
+                n_dot_h += n[c] * half_dir[c];
+            }
+            n_dot_l /= n_len * light_len;
+            n_dot_h /= n_len * half_len;
+
+            float diffuse = std::max(0.f, n_dot_l);
+            float specular = std::pow(std::max(0.f, n_dot_h), uniforms.shininess);
+            for (int c = 0; c < 3; ++c)
+            {
+                float intensity = light.intensity[c] / r2;
+                result[c] += ambient[c] + (diffuse * kd[c][lane] + specular * uniforms.ks[c]) * intensity;
+            }
+        }
+        for (int c = 0; c < 3; ++c)
+        {
+            out.rgb[c][lane] = result[c] * 255.f;
+        }
+    }
+}
+
+struct phong_packet_shader
+{
+    void operator()(const fragment_packet& in, color_packet& out) const { blinn_phong_packet(in, in.color, out); }
+};
+
+struct texture_packet_shader
+{
+    void operator()(const fragment_packet& in, color_packet& out) const
+    {
+        float kd[3][packet_width] = {};
+        for (unsigned mask = in.texture ? in.mask : 0; mask; mask &= mask - 1)
+        {
+            int lane = __builtin_ctz(mask);
+            Eigen::Vector3f texture_color = in.texture->sample(in.tex_coords[0][lane], in.tex_coords[1][lane],
+                                                               {in.tex_coords_dx[0][lane], in.tex_coords_dx[1][lane]},
+                                                               {in.tex_coords_dy[0][lane], in.tex_coords_dy[1][lane]});
+            for (int c = 0; c < 3; ++c)
+            {
+                kd[c][lane] = texture_color[c] / 255.f;
+            }
+        }
+        blinn_phong_packet(in, kd, out);
+    }
+};
@@ -0,0 +1,89 @@
+//
+// Fixed-size worker pool used by the rasterizer to process screen tiles in parallel.
+//
+
+#include "thread_pool.hpp"
+
+rst::thread_pool::thread_pool(int thread_count)
+{
+    // The calling thread also executes tasks, so only thread_count - 1 workers are spawned.
+    for (int i = 1; i < thread_count; ++i)
+    {
+        workers.emplace_back([this] { worker_loop(); });
+    }
+}
+
+rst::thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void rst::thread_pool::parallel_for(int count, const std::function<void(int)>& task)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    if (workers.empty() || count == 1)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current_task = &task;
+        task_count = count;
+        next_task = 0;
+        ++generation;
+    }
+    work_ready.notify_all();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    run_tasks(lock);
+    work_done.wait(lock, [this] { return next_task >= task_count && active_workers == 0; });
+    current_task = nullptr;
+}
+
+void rst::thread_pool::run_tasks(std::unique_lock<std::mutex>& lock)
+{
+    while (next_task < task_count)
+    {
+        int index = next_task++;
+        const auto* task = current_task;
+        lock.unlock();
+        (*task)(index);
+        lock.lock();
+    }
+}
+
+void rst::thread_pool::worker_loop()
+{
+    unsigned seen_generation = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        work_ready.wait(lock, [&] { return stopping || generation != seen_generation; });
+        if (stopping)
+        {
+            return;
+        }
+        seen_generation = generation;
+
+        ++active_workers;
+        run_tasks(lock);
+        --active_workers;
+        work_done.notify_all();
+    }
+}
@@ -0,0 +1,50 @@
+//
+// Fixed-size worker pool used by the rasterizer to process screen tiles in parallel.
+//
+
+#ifndef RASTERIZER_THREAD_POOL_H
+#define RASTERIZER_THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rst
+{
+    class thread_pool
+    {
+    public:
+        explicit thread_pool(int thread_count);
+        ~thread_pool();
+
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        int size() const { return (int)workers.size() + 1; }
+
+        // Runs task(0) ... task(count - 1) on the workers and the calling thread,
+        // returns once every index has been processed. Indices are handed out dynamically.
+        void parallel_for(int count, const std::function<void(int)>& task);
+
+    private:
+        void worker_loop();
+        void run_tasks(std::unique_lock<std::mutex>& lock);
+
+        std::vector<std::thread> workers;
+
+        std::mutex mutex;
+        std::condition_variable work_ready;
+        std::condition_variable work_done;
+
+        const std::function<void(int)>* current_task = nullptr;
+        int task_count = 0;
+        int next_task = 0;
+        int active_workers = 0;
+        unsigned generation = 0;
+        bool stopping = false;
+    };
+}
+
+#endif //RASTERIZER_THREAD_POOL_H
@@ -0,0 +1,104 @@
+//
+// Model, view and projection matrices shared by the renderer and the benchmarks.
+//
+
+#include <cmath>
+#include "global.hpp"
+#include "transforms.hpp"
+
+Eigen::Matrix4f get_view_matrix(Eigen::Vector3f eye_pos)
+{
+    Eigen::Matrix4f view = Eigen::Matrix4f::Identity();
+
+    Eigen::Matrix4f translate;
+    translate << 1,0,0,-eye_pos[0],
+                 0,1,0,-eye_pos[1],
+                 0,0,1,-eye_pos[2],
+                 0,0,0,1;
+
+    view = translate*view;
+
+    return view;
+}
+
+Eigen::Matrix4f get_model_matrix(float angle)
+{
+    Eigen::Matrix4f rotation;
+    angle = angle * MY_PI / 180.f;
+    rotation << cos(angle), 0, sin(angle), 0,
+                0, 1, 0, 0,
+                -sin(angle), 0, cos(angle), 0,
+                0, 0, 0, 1;
+
+    Eigen::Matrix4f scale;
+    scale << 2.5, 0, 0, 0,
+              0, 2.5, 0, 0,
+              0, 0, 2.5, 0,
+              0, 0, 0, 1;
+
+    Eigen::Matrix4f translate;
+    translate << 1, 0, 0, 0,
+            0, 1, 0, 0,
+            0, 0, 1, 0,
+            0, 0, 0, 1;
+
+    return translate * rotation * scale;
+}
+
+Eigen::Matrix4f get_model_matrix(float angle, float scale, const Eigen::Vector3f& position)
+{
+    Eigen::Matrix4f rotation;
+    angle = angle * MY_PI / 180.f;
+    rotation << cos(angle), 0, sin(angle), 0,
+                0, 1, 0, 0,
+                -sin(angle), 0, cos(angle), 0,
+                0, 0, 0, 1;
+
+    Eigen::Matrix4f translate = Eigen::Matrix4f::Identity();
+    translate.topRightCorner<3, 1>() = position;
+
+    return translate * rotation * Eigen::Matrix4f(Eigen::Vector4f(scale, scale, scale, 1).asDiagonal());
+}
+
+Eigen::Matrix4f get_projection_matrix(float eye_fov, float aspect_ratio, float zNear, float zFar)
+{
+    // TODO: Use the same projection matrix from the previous assignments
+  float radian = (eye_fov / 365) * (2 * MY_PI);
+  // opencv 中
+  // 右侧是x轴正方向，y轴正方向向下，
+  // 这就导致 y轴和z轴是相反的和推到过程中
+  // 修改分两点
+  // 1：不用写，纠正z轴
+  // zNear = -zNear;
+  // zFar = -zFar;
+  // 2：求yTop的时候乘以 -1，纠正Y轴
+
+  float yTop = -1 * (std::tan(radian / 2) * zNear); // -1 兼容opencv
+  float yBottom = -yTop;
+
+  float xLeft = -1 * ((yTop - yBottom) * aspect_ratio / 2);
+  float xRight = -xLeft;
+
+  Eigen::Matrix4f scale_mat;
+  scale_mat << 2 / (xRight - xLeft), 0, 0, 0, 0, 2 / (yTop - yBottom), 0, 0, 0,
+      0, 2 / (zNear - zFar), 0, 0, 0, 0, 1;
+  // // std::cout << "scale_mat: \n" << scale_mat << std::endl;
+
+  Eigen::Matrix4f move_mat;
+  move_mat << 1, 0, 0, -(xLeft + xRight) / 2, 0, 1, 0, -(yTop + yBottom) / 2, 0,
+      0, 1, -(zFar + zNear) / 2, 0, 0, 0, 1;
+
+  // // std::cout << "move_mat: \n" << move_mat << std::endl;
+
+  Eigen::Matrix4f persp_mat;
+  persp_mat << zNear, 0, 0, 0, 0, zNear, 0, 0, 0, 0, (zFar + zNear),
+      -(zNear * zFar), 0, 0, 1, 0;
+
+  // // std::cout << "persp_mat: \n" << persp_mat << std::endl;
+
+  Eigen::Matrix4f projection = scale_mat * move_mat * persp_mat;
+
+  // std::cout << "projection: \n" << projection << std::endl;
+
+  return projection;
+}
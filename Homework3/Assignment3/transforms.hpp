@@ -0,0 +1,21 @@
+//
+// Model, view and projection matrices shared by the renderer and the benchmarks.
+//
+
+#ifndef RASTERIZER_TRANSFORMS_H
+#define RASTERIZER_TRANSFORMS_H
+
+#include <eigen3/Eigen/Eigen>
+
+Eigen::Matrix4f get_view_matrix(Eigen::Vector3f eye_pos);
+
+// Rotation by angle degrees around y, after a uniform scale of 2.5.
+Eigen::Matrix4f get_model_matrix(float angle);
+
+// Uniform scale, then rotation by angle degrees around y, then translation to position: an object
+// placed in a scene.
+Eigen::Matrix4f get_model_matrix(float angle, float scale, const Eigen::Vector3f& position);
+
+Eigen::Matrix4f get_projection_matrix(float eye_fov, float aspect_ratio, float zNear, float zFar);
+
+#endif //RASTERIZER_TRANSFORMS_H